@@ -31,6 +31,60 @@
 #include "Osc.h"
 #include "cinder/Log.h"
 
+#include <future>
+
+#if defined( __linux__ )
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+// UDP generic segmentation offload, available since Linux 4.18. Older headers don't define it.
+#define OSC_HAS_UDP_SEGMENT 1
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+// Receives several datagrams per syscall, available since Linux 2.6.33.
+#define OSC_HAS_RECVMMSG 1
+// Sockets sharing a port with the kernel balancing between them, available since Linux 3.9, and a
+// classic BPF program picking the socket, available since Linux 4.5.
+#include <linux/filter.h>
+#define OSC_HAS_REUSEPORT 1
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+// The socket's running count of datagrams dropped for lack of buffer space, attached to received
+// datagrams. Available since Linux 2.6.33.
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+// Kernel receive timestamps as a control message, with nanosecond resolution since Linux 2.6.22.
+#define OSC_HAS_RECEIVE_TIMESTAMPS 1
+#ifndef SO_TIMESTAMPNS
+#define SO_TIMESTAMPNS 35
+#endif
+#ifndef SCM_TIMESTAMPNS
+#define SCM_TIMESTAMPNS SO_TIMESTAMPNS
+#endif
+#endif
+
+// Used to scan for SLIP special bytes 16 at a time.
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define OSC_HAS_SSE2 1
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#elif defined( __aarch64__ ) && defined( __ARM_NEON )
+#include <arm_neon.h>
+#define OSC_HAS_NEON 1
+#endif
+
 using namespace std;
 using namespace asio;
 using namespace asio::ip;
@@ -84,7 +138,7 @@ Message::Message( const std::string& address )
 Message::Message( Message &&message ) NOEXCEPT
 : mAddress( move( message.mAddress ) ), mDataBuffer( move( message.mDataBuffer ) ),
 	mDataViews( move( message.mDataViews ) ), mIsCached( message.mIsCached ),
-	mCache( move( message.mCache ) )
+	mCache( move( message.mCache ) ), mReceiveTime( message.mReceiveTime ), mBundleTimetag( message.mBundleTimetag )
 {
 	for( auto & dataView : mDataViews ) {
 		dataView.mOwner = this;
@@ -99,6 +153,8 @@ Message& Message::operator=( Message &&message ) NOEXCEPT
 		mDataViews = move( message.mDataViews );
 		mIsCached = message.mIsCached;
 		mCache = move( message.mCache );
+		mReceiveTime = message.mReceiveTime;
+		mBundleTimetag = message.mBundleTimetag;
 		for( auto & dataView : mDataViews ) {
 			dataView.mOwner = this;
 		}
@@ -109,7 +165,8 @@ Message& Message::operator=( Message &&message ) NOEXCEPT
 Message::Message( const Message &message )
 : mAddress( message.mAddress ), mDataBuffer( message.mDataBuffer ),
 	mDataViews( message.mDataViews ), mIsCached( message.mIsCached ),
-	mCache( mIsCached ? new ByteBuffer( *(message.mCache) ) : nullptr )
+	mCache( mIsCached ? new ByteBuffer( *(message.mCache) ) : nullptr ),
+	mReceiveTime( message.mReceiveTime ), mBundleTimetag( message.mBundleTimetag )
 {
 	for( auto & dataView : mDataViews ) {
 		dataView.mOwner = this;
@@ -124,6 +181,8 @@ Message& Message::operator=( const Message &message )
 		mDataViews = message.mDataViews;
 		mIsCached = message.mIsCached;
 		mCache.reset( mIsCached ? new ByteBuffer( *(message.mCache) ) : nullptr );
+		mReceiveTime = message.mReceiveTime;
+		mBundleTimetag = message.mBundleTimetag;
 		for( auto & dataView : mDataViews ) {
 			dataView.mOwner = this;
 		}
@@ -700,7 +759,7 @@ void Message::getArgBlobData( uint32_t index, const void **dataPtr, size_t *size
 	dataView.blobData( dataPtr, size );
 }
 
-bool Message::bufferCache( uint8_t *data, size_t size )
+bool Message::bufferCache( uint8_t *data, size_t size, ParseError &error )
 {
 	uint8_t *head, *tail;
 	uint32_t i = 0;
@@ -708,40 +767,57 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 	
 	// extract address
 	head = tail = data;
+	if( remain == 0 ) {
+		error = ParseError::MISSING_ADDRESS;
+		return false;
+	}
 	while( tail[i] != '\0' && ++i < remain );
 	if( i == remain ) {
-		CI_LOG_E( "Problem Parsing Message: No address." );
+		error = ParseError::MISSING_ADDRESS;
 		return false;
 	}
 	
 	mAddress.insert( 0, (char*)head, i );
 	
+	if( i + getTrailingZeros( i ) >= size ) {
+		error = ParseError::MISSING_TYPE_TAGS;
+		return false;
+	}
 	head += i + getTrailingZeros( i );
 	remain = size - ( head - data );
 	
 	i = 0;
 	tail = head;
 	if( head[i++] != ',' ) {
-		CI_LOG_E( "Problem Parsing Message: Mesage with address [" << mAddress << "] not properly formatted; no , seperator."  );
+		error = ParseError::MISSING_TYPE_TAGS;
 		return false;
 	}
 	
 	// extract types
-	while( tail[i] != '\0' && ++i < remain );
+	while( i < remain && tail[i] != '\0' && ++i < remain );
 	if( i == remain ) {
-		CI_LOG_E( "Problem Parsing Message:  Mesage with address [" << mAddress << "] not properly formatted; Types not complete." );
+		error = ParseError::INCOMPLETE_TYPE_TAGS;
 		return false;
 	}
 	
 	std::vector<char> types( i - 1 );
 	std::copy( head + 1, head + i, types.begin() );
 	head += i + getTrailingZeros( i );
-	remain = size - ( head - data );
+	// the type tags' padding may run past the end, which only matters if an argument follows
+	remain = size > size_t( head - data ) ? size - ( head - data ) : 0;
 	
 	// extract data
 	uint32_t int32;
 	uint64_t int64;
 	
+	// Returns false, reporting the packet as truncated, unless \a needed more bytes are left.
+	auto isRemaining = [&]( size_t needed ) {
+		if( remain >= needed )
+			return true;
+		error = ParseError::TRUNCATED;
+		return false;
+	};
+	
 	mDataViews.resize( types.size() );
 	int j = 0;
 	for( auto & dataView : mDataViews ) {
@@ -751,6 +827,8 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 			case 'i':
 			case 'f':
 			case 'r': {
+				if( ! isRemaining( sizeof( uint32_t ) ) )
+					return false;
 				dataView.mSize = sizeof( uint32_t );
 				dataView.mOffset = getCurrentOffset();
 				memcpy( &int32, head, sizeof( uint32_t ) );
@@ -761,12 +839,14 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 			}
 			break;
 			case 'b': {
+				if( ! isRemaining( 4 ) )
+					return false;
 				memcpy( &int32, head, 4 );
 				head += 4;
 				remain -= 4;
 				int32 = htonl( int32 );
 				if( int32 > remain ) {
-					CI_LOG_E( "Problem Parsing Message:  Mesage with address [" << mAddress << "] not properly formatted; Blobs size is too long." );
+					error = ParseError::BLOB_TOO_LONG;
 					return false;
 				}
 				auto trailingZeros = getTrailingZeros( int32 );
@@ -774,26 +854,32 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 				dataView.mOffset = getCurrentOffset();
 				appendDataBuffer( &dataView.mSize, sizeof( uint32_t ) );
 				appendDataBuffer( head, int32, trailingZeros );
-				head += int32 + trailingZeros;
-				remain -= int32 + trailingZeros;
+				// padding at the very end may be left off
+				auto advance = std::min<size_t>( int32 + trailingZeros, remain );
+				head += advance;
+				remain -= advance;
 			}
 			break;
 			case 's':
 			case 'S': {
+				if( ! isRemaining( 1 ) )
+					return false;
 				tail = head;
 				i = 0;
 				while( tail[i] != '\0' && ++i < remain );
 				dataView.mSize = i + getTrailingZeros( i );
 				dataView.mOffset = getCurrentOffset();
 				appendDataBuffer( head, i, getTrailingZeros( i ) );
-				i += getTrailingZeros( i );
-				head += i;
-				remain -= i;
+				auto advance = std::min<size_t>( i + getTrailingZeros( i ), remain );
+				head += advance;
+				remain -= advance;
 			}
 				break;
 			case 'h':
 			case 'd':
 			case 't': {
+				if( ! isRemaining( sizeof( uint64_t ) ) )
+					return false;
 				memcpy( &int64, head, sizeof( uint64_t ) );
 				int64 = htonll( int64 );
 				dataView.mSize = sizeof( uint64_t );
@@ -804,6 +890,8 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 			}
 				break;
 			case 'c': {
+				if( ! isRemaining( 4 ) )
+					return false;
 				dataView.mSize = 4;
 				dataView.mOffset = getCurrentOffset();
 				memcpy( &int32, head, 4 );
@@ -814,6 +902,8 @@ bool Message::bufferCache( uint8_t *data, size_t size )
 			}
 				break;
 			case 'm': {
+				if( ! isRemaining( sizeof( int ) ) )
+					return false;
 				dataView.mSize = sizeof( int );
 				dataView.mOffset = getCurrentOffset();
 				appendDataBuffer( head, sizeof( int ) );
@@ -848,6 +938,8 @@ void Message::clear()
 	mDataViews.clear();
 	mDataBuffer.clear();
 	mCache.reset();
+	mReceiveTime = std::chrono::nanoseconds::zero();
+	mBundleTimetag = 0;
 }
 
 std::ostream& operator<<( std::ostream &os, const Message &rhs )
@@ -878,7 +970,8 @@ void Bundle::setTimetag( uint64_t ntp_time )
 	uint64_t a = htonll( ntp_time );
 	ByteArray<8> b;
 	memcpy( b.data(), reinterpret_cast<uint8_t*>( &a ), 8 );
-	mDataBuffer->insert( mDataBuffer->begin() + 12, b.begin(), b.end() );
+	// overwrites the immediate time tag the bundle was initialized with
+	std::copy( b.begin(), b.end(), mDataBuffer->begin() + 12 );
 }
 	
 void Bundle::initializeBuffer()
@@ -921,26 +1014,381 @@ void SenderBase::handleError( const asio::error_code &error, const std::string &
 		CI_LOG_E( "Socket error: " << error.message() << ", didn't send message [" << oscAddress << "]" );
 }
 
+SenderBase::~SenderBase()
+{
+	detachPacingTimer();
+}
+
+void SenderBase::detachPacingTimer()
+{
+	if( ! mPacingTimer )
+		return;
+	std::lock_guard<std::mutex> lock( mPacingTimer->mMutex );
+	mPacingTimer->mSender = nullptr;
+	asio::error_code ec;
+	mPacingTimer->mTimer.cancel( ec );
+}
+
+void SenderBase::setPacing( const PacingOptions &options )
+{
+	std::unique_lock<std::mutex> lock( mPacingMutex );
+	mPacingOptions = options;
+	if( ! mPacingTimer )
+		mPacingTimer = std::make_shared<PacingTimer>( getIoService(), this );
+	// Start with a full bucket, so the first burst goes out immediately.
+	mMessageTokens = mPacingOptions.burstMessages;
+	mByteTokens = mPacingOptions.burstBytes ? mPacingOptions.burstBytes : mPacingOptions.bytesPerSecond;
+	mLastRefill = PacingClock::now();
+	mPacingEnabled = true;
+	if( ! mPacingQueue.empty() && ! mPacingTimerArmed )
+		releasePacedPackets();
+	dispatchReadyPackets( lock );
+}
+
+void SenderBase::disablePacing()
+{
+	std::unique_lock<std::mutex> lock( mPacingMutex );
+	mPacingEnabled = false;
+	if( mPacingTimer )
+		mPacingTimer->mTimer.cancel();
+	mPacingTimerArmed = false;
+	while( ! mPacingQueue.empty() ) {
+		mReadyPackets.push_back( std::move( mPacingQueue.front() ) );
+		mPacingQueue.pop_front();
+		mPacingStats.sent++;
+	}
+	dispatchReadyPackets( lock );
+}
+
+SenderBase::PacingStats SenderBase::getPacingStats() const
+{
+	std::lock_guard<std::mutex> lock( mPacingMutex );
+	auto stats = mPacingStats;
+	stats.queueDepth = mPacingQueue.size();
+	if( stats.delayed )
+		stats.averageDelay = std::chrono::microseconds( mTotalPacingDelayUs / stats.delayed );
+	return stats;
+}
+
+bool SenderBase::send( const Message &message, SendCompletionFn onComplete )
+{
+	auto data = message.getSharedBuffer();
+	if( suppressUnchanged( message, data, onComplete ) )
+		return true;
+	return transmit( data, std::move( onComplete ) );
+}
+
+bool SenderBase::suppressUnchanged( const Message &message, const ByteBufferRef &data, SendCompletionFn &onComplete )
+{
+	if( ! mChangeSuppressionEnabled )
+		return false;
+	if( isUnchanged( message.getAddress(), data ) ) {
+		mSuppressedCount++;
+		if( onComplete )
+			onComplete( asio::error_code() );
+		return true;
+	}
+	// Recorded up front so an identical send racing this one is still skipped, but a value that never
+	// went out mustn't keep its successors from going.
+	auto address = message.getAddress();
+	auto completion = std::move( onComplete );
+	onComplete = [this, address, data, completion]( const asio::error_code &error ) {
+		if( error )
+			forgetLastValue( address, data );
+		if( completion )
+			completion( error );
+	};
+	return false;
+}
+
+void SenderBase::setChangeSuppression( bool enable, std::chrono::milliseconds refreshInterval )
+{
+	std::lock_guard<std::mutex> lock( mLastValuesMutex );
+	mRefreshInterval = refreshInterval;
+	mChangeSuppressionEnabled = enable;
+	if( ! enable )
+		mLastValues.clear();
+}
+
+void SenderBase::resetChangeSuppression()
+{
+	std::lock_guard<std::mutex> lock( mLastValuesMutex );
+	mLastValues.clear();
+}
+
+bool SenderBase::isUnchanged( const std::string &address, const ByteBufferRef &data )
+{
+	// FNV-1a, cheap enough to run per send and rules out nearly all changed values without a compare.
+	size_t hash = 2166136261u;
+	for( auto byte : *data )
+		hash = ( hash ^ byte ) * 16777619u;
+	
+	auto now = PacingClock::now();
+	std::lock_guard<std::mutex> lock( mLastValuesMutex );
+	auto &lastValue = mLastValues[address];
+	bool unchanged = ! lastValue.bytes.empty() && lastValue.hash == hash && lastValue.bytes == *data;
+	if( unchanged && ( mRefreshInterval.count() == 0 || now - lastValue.sent < mRefreshInterval ) )
+		return true;
+	
+	lastValue.hash = hash;
+	if( ! unchanged )
+		lastValue.bytes.assign( data->begin(), data->end() );
+	lastValue.sent = now;
+	return false;
+}
+
+void SenderBase::forgetLastValue( const std::string &address, const ByteBufferRef &data )
+{
+	std::lock_guard<std::mutex> lock( mLastValuesMutex );
+	auto found = mLastValues.find( address );
+	if( found != mLastValues.end() && found->second.bytes == *data )
+		mLastValues.erase( found );
+}
+
+void SenderBase::setHighWaterMark( size_t maxSends, size_t maxBytes, BackpressurePolicy policy )
+{
+	mMaxInFlightSends = maxSends;
+	mMaxInFlightBytes = maxBytes;
+	mBackpressurePolicy = policy;
+}
+
+void SenderBase::setBackpressureFn( BackpressureFn backpressureFn )
+{
+	std::lock_guard<std::mutex> lock( mBackpressureFnMutex );
+	mBackpressureFn = backpressureFn;
+}
+
+bool SenderBase::isWithinHighWaterMark( size_t numSends, size_t size ) const
+{
+	size_t maxSends = mMaxInFlightSends, maxBytes = mMaxInFlightBytes;
+	return ( ! maxSends || mInFlightSends + numSends <= maxSends ) && ( ! maxBytes || mInFlightBytes + size <= maxBytes );
+}
+
+bool SenderBase::transmit( const ByteBufferRef &data, SendCompletionFn onComplete )
+{
+	if( ! isWithinHighWaterMark( 1, data->size() ) ) {
+		if( mBackpressurePolicy == BackpressurePolicy::REJECT ) {
+			if( onComplete )
+				onComplete( asio::error::no_buffer_space );
+			return false;
+		}
+		std::lock_guard<std::mutex> lock( mBackpressureFnMutex );
+		if( mBackpressureFn )
+			mBackpressureFn( mInFlightSends, mInFlightBytes );
+	}
+	
+	if( ! mPacingEnabled ) {
+		dispatchSend( data, onComplete );
+		return true;
+	}
+	
+	std::unique_lock<std::mutex> lock( mPacingMutex );
+	if( ! mPacingEnabled ) {
+		// Behind whatever disablePacing released.
+		mReadyPackets.push_back( { data, std::move( onComplete ), PacingClock::now() } );
+		dispatchReadyPackets( lock );
+		return true;
+	}
+	// Anything already waiting goes first to keep packets in order.
+	if( mPacingQueue.empty() ) {
+		refillPacingTokens( PacingClock::now() );
+		if( takePacingTokens( data->size() ) ) {
+			mPacingStats.sent++;
+			mReadyPackets.push_back( { data, std::move( onComplete ), PacingClock::now() } );
+			dispatchReadyPackets( lock );
+			return true;
+		}
+	}
+	
+	SendCompletionFn droppedFn;
+	bool accepted = true;
+	switch( mPacingOptions.policy ) {
+		case PacingPolicy::DROP:
+			accepted = false;
+		break;
+		case PacingPolicy::QUEUE:
+			accepted = mPacingQueue.size() < mPacingOptions.maxQueueSize;
+		break;
+		case PacingPolicy::QUEUE_DROP_OLDEST:
+			if( mPacingQueue.size() >= mPacingOptions.maxQueueSize ) {
+				if( mPacingQueue.empty() )
+					accepted = false;
+				else {
+					droppedFn = std::move( mPacingQueue.front().onComplete );
+					mPacingQueue.pop_front();
+					mPacingStats.dropped++;
+				}
+			}
+		break;
+	}
+	
+	if( accepted ) {
+		mPacingQueue.push_back( { data, std::move( onComplete ), PacingClock::now() } );
+		if( ! mPacingTimerArmed )
+			releasePacedPackets();
+	}
+	else {
+		droppedFn = std::move( onComplete );
+		mPacingStats.dropped++;
+	}
+	dispatchReadyPackets( lock );
+	lock.unlock();
+	// Let the producer know outside of the lock, it may well send again from the callback.
+	if( droppedFn )
+		droppedFn( asio::error::no_buffer_space );
+	return accepted;
+}
+
+void SenderBase::dispatchSend( const ByteBufferRef &data, const SendCompletionFn &onComplete )
+{
+	sendImpl( data, trackInFlight( 1, data->size(), onComplete ) );
+}
+
+void SenderBase::dispatchReadyPackets( std::unique_lock<std::mutex> &lock )
+{
+	if( mDispatchingReady )
+		return;
+	mDispatchingReady = true;
+	std::vector<PacedPacket> packets;
+	while( ! mReadyPackets.empty() ) {
+		packets.swap( mReadyPackets );
+		lock.unlock();
+		for( auto & packet : packets )
+			dispatchSend( packet.data, packet.onComplete );
+		packets.clear();
+		lock.lock();
+	}
+	mDispatchingReady = false;
+}
+
+SenderBase::SendCompletionFn SenderBase::trackInFlight( size_t numSends, size_t size, SendCompletionFn onComplete )
+{
+	mInFlightSends += numSends;
+	mInFlightBytes += size;
+	return [this, numSends, size, onComplete]( const asio::error_code &error ) {
+		mInFlightSends -= numSends;
+		mInFlightBytes -= size;
+		if( onComplete ) {
+			for( size_t i = 0; i < numSends; i++ )
+				onComplete( error );
+		}
+	};
+}
+
+void SenderBase::refillPacingTokens( PacingClock::time_point now )
+{
+	double elapsed = std::chrono::duration<double>( now - mLastRefill ).count();
+	mLastRefill = now;
+	if( mPacingOptions.messagesPerSecond > 0 ) {
+		mMessageTokens = std::min<double>( mMessageTokens + elapsed * mPacingOptions.messagesPerSecond,
+										   std::max<uint32_t>( mPacingOptions.burstMessages, 1 ) );
+	}
+	if( mPacingOptions.bytesPerSecond > 0 ) {
+		double burstBytes = mPacingOptions.burstBytes ? mPacingOptions.burstBytes : mPacingOptions.bytesPerSecond;
+		mByteTokens = std::min( mByteTokens + elapsed * mPacingOptions.bytesPerSecond, burstBytes );
+	}
+}
+
+bool SenderBase::takePacingTokens( size_t size )
+{
+	bool messagesAvailable = mPacingOptions.messagesPerSecond <= 0 || mMessageTokens >= 1;
+	// A packet larger than the burst allowance would never fit, so it only waits for a full bucket and
+	// leaves the bucket in debt.
+	double burstBytes = mPacingOptions.burstBytes ? mPacingOptions.burstBytes : mPacingOptions.bytesPerSecond;
+	bool bytesAvailable = mPacingOptions.bytesPerSecond <= 0 || mByteTokens >= std::min<double>( size, burstBytes );
+	if( ! messagesAvailable || ! bytesAvailable )
+		return false;
+	
+	if( mPacingOptions.messagesPerSecond > 0 )
+		mMessageTokens -= 1;
+	if( mPacingOptions.bytesPerSecond > 0 )
+		mByteTokens -= size;
+	return true;
+}
+
+void SenderBase::releasePacedPackets()
+{
+	auto now = PacingClock::now();
+	refillPacingTokens( now );
+	while( ! mPacingQueue.empty() && takePacingTokens( mPacingQueue.front().data->size() ) ) {
+		auto &packet = mPacingQueue.front();
+		auto delay = std::chrono::duration_cast<std::chrono::microseconds>( now - packet.queued );
+		mPacingStats.sent++;
+		mPacingStats.delayed++;
+		mPacingStats.lastDelay = delay;
+		mPacingStats.maxDelay = std::max( mPacingStats.maxDelay, delay );
+		mTotalPacingDelayUs += delay.count();
+		mReadyPackets.push_back( std::move( packet ) );
+		mPacingQueue.pop_front();
+	}
+	if( mPacingQueue.empty() ) {
+		mPacingTimerArmed = false;
+		return;
+	}
+	
+	// Sleep until both buckets hold enough for the packet at the front of the queue.
+	double wait = 0;
+	if( mPacingOptions.messagesPerSecond > 0 && mMessageTokens < 1 )
+		wait = ( 1 - mMessageTokens ) / mPacingOptions.messagesPerSecond;
+	if( mPacingOptions.bytesPerSecond > 0 ) {
+		double burstBytes = mPacingOptions.burstBytes ? mPacingOptions.burstBytes : mPacingOptions.bytesPerSecond;
+		double needed = std::min<double>( mPacingQueue.front().data->size(), burstBytes );
+		if( mByteTokens < needed )
+			wait = std::max( wait, ( needed - mByteTokens ) / mPacingOptions.bytesPerSecond );
+	}
+	
+	mPacingTimerArmed = true;
+	auto timer = mPacingTimer;
+	timer->mTimer.expires_from_now( std::chrono::duration_cast<PacingClock::duration>( std::chrono::duration<double>( wait ) ) );
+	timer->mTimer.async_wait(
+	[timer]( const asio::error_code &error ) {
+		if( error == asio::error::operation_aborted )
+			return;
+		std::lock_guard<std::mutex> timerLock( timer->mMutex );
+		auto sender = timer->mSender;
+		if( ! sender )
+			return;
+		std::unique_lock<std::mutex> lock( sender->mPacingMutex );
+		sender->mPacingTimerArmed = false;
+		if( sender->mPacingEnabled )
+			sender->releasePacedPackets();
+		sender->dispatchReadyPackets( lock );
+	});
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 //// SenderUdp
 
 SenderUdp::SenderUdp( uint16_t localPort, const std::string &destinationHost, uint16_t destinationPort, const protocol &protocol, asio::io_service &service )
 : SenderBase( nullptr ), mSocket( new udp::socket( service ) ), mLocalEndpoint( protocol, localPort ),
-	mRemoteEndpoint( udp::endpoint( address::from_string( destinationHost ), destinationPort ) )
+	mRemoteEndpoint( udp::endpoint( address::from_string( destinationHost ), destinationPort ) ),
+	mSegmentationOffloadEnabled( false ), mSegmentationOffloadSupported( false ), mPendingSends( 0 )
 {
 }
 	
 SenderUdp::SenderUdp( uint16_t localPort, const protocol::endpoint &destination, const protocol &protocol, asio::io_service &service )
 : SenderBase( nullptr ), mSocket( new udp::socket( service ) ), mLocalEndpoint( protocol, localPort ),
-	mRemoteEndpoint( destination )
+	mRemoteEndpoint( destination ), mSegmentationOffloadEnabled( false ), mSegmentationOffloadSupported( false ), mPendingSends( 0 )
 {
 }
 	
 SenderUdp::SenderUdp( const UdpSocketRef &socket, const protocol::endpoint &destination )
-: SenderBase( nullptr ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mRemoteEndpoint( destination )
-{
+: SenderBase( nullptr ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mRemoteEndpoint( destination ),
+	mSegmentationOffloadEnabled( false ), mSegmentationOffloadSupported( false ), mPendingSends( 0 )
+{
+#if defined( OSC_HAS_UDP_SEGMENT )
+	int segmentSize = 0;
+	socklen_t optionLength = sizeof( segmentSize );
+	mSegmentationOffloadSupported = mSocket->is_open() &&
+		! getsockopt( mSocket->native_handle(), SOL_UDP, UDP_SEGMENT, &segmentSize, &optionLength );
+#endif
 }
 	
+SenderUdp::~SenderUdp()
+{
+	detachPacingTimer();
+}
+
 void SenderUdp::bindImpl()
 {
 	asio::error_code ec;
@@ -950,17 +1398,27 @@ void SenderUdp::bindImpl()
 		return;
 	}
 	mSocket->bind( mLocalEndpoint, ec );
-	if( ec )
+	if( ec ) {
 		handleError( ec, "" );
+		return;
+	}
+#if defined( OSC_HAS_UDP_SEGMENT )
+	// Kernels without segmentation offload don't know the option.
+	int segmentSize = 0;
+	socklen_t optionLength = sizeof( segmentSize );
+	mSegmentationOffloadSupported = ! getsockopt( mSocket->native_handle(), SOL_UDP, UDP_SEGMENT, &segmentSize, &optionLength );
+#endif
 }
 	
-void SenderUdp::sendImpl( const ByteBufferRef &data )
+void SenderUdp::sendImpl( const ByteBufferRef &data, SendCompletionFn onComplete )
 {
+	mPendingSends++;
 	// data's first 4 bytes(int) comprise the size of the buffer, which datagram doesn't need.
 	mSocket->async_send_to( asio::buffer( data->data() + 4, data->size() - 4 ), mRemoteEndpoint,
 	// copy data pointer to persist the asynchronous send
-	[&, data]( const asio::error_code& error, size_t bytesTransferred )
+	[&, data, onComplete]( const asio::error_code& error, size_t bytesTransferred )
 	{
+		mPendingSends--;
 		if( error ) {
 			// derive oscAddress
 			std::string oscAddress;
@@ -971,9 +1429,138 @@ void SenderUdp::sendImpl( const ByteBufferRef &data )
 			}
 			handleError( error, oscAddress );
 		}
+		onComplete( error );
 	});
 }
 	
+void SenderUdp::sendBurst( const std::vector<Message> &messages, SendCompletionFn onComplete )
+{
+#if defined( OSC_HAS_UDP_SEGMENT )
+	// The kernel caps a segmented send to 64 segments and one maximum sized datagram worth of payload.
+	static const size_t sMaxSegments = 64;
+	static const size_t sMaxSegmentedPayload = 65507;
+	
+	// Suppressed messages drop out before the runs are formed, so they can't split one.
+	std::vector<ByteBufferRef> datagrams;
+	std::vector<SendCompletionFn> completions;
+	datagrams.reserve( messages.size() );
+	completions.reserve( messages.size() );
+	for( auto & message : messages ) {
+		auto data = message.getSharedBuffer();
+		auto completion = onComplete;
+		if( ! suppressUnchanged( message, data, completion ) ) {
+			datagrams.push_back( std::move( data ) );
+			completions.push_back( std::move( completion ) );
+		}
+	}
+	
+	// Local to the burst, so bursts from several threads don't share it.
+	ByteBuffer segmentBuffer;
+	size_t i = 0;
+	while( i < datagrams.size() ) {
+		// data's first 4 bytes(int) comprise the size of the buffer, which datagram doesn't need.
+		auto segmentSize = datagrams[i]->size() - 4;
+		auto end = i + 1;
+		// Paced packets have to go through the queue one by one.
+		if( mSegmentationOffloadEnabled && mSegmentationOffloadSupported && ! isPacingEnabled() ) {
+			// Only the last segment may be shorter than the rest.
+			size_t payload = segmentSize;
+			while( end < datagrams.size() && end - i < sMaxSegments ) {
+				auto nextSize = datagrams[end]->size() - 4;
+				if( nextSize > segmentSize || payload + nextSize > sMaxSegmentedPayload )
+					break;
+				payload += nextSize;
+				if( nextSize < segmentSize ) {
+					++end;
+					break;
+				}
+				++end;
+			}
+		}
+		if( end - i < 2 || ! sendSegmented( datagrams, completions, i, end, segmentSize, segmentBuffer ) ) {
+			for( auto j = i; j < end; j++ )
+				transmit( datagrams[j], std::move( completions[j] ) );
+		}
+		i = end;
+	}
+#else
+	for( auto & message : messages )
+		send( message, onComplete );
+#endif
+}
+
+bool SenderUdp::sendSegmented( const std::vector<ByteBufferRef> &datagrams, const std::vector<SendCompletionFn> &completions,
+							   size_t begin, size_t end, size_t segmentSize, ByteBuffer &segmentBuffer )
+{
+#if defined( OSC_HAS_UDP_SEGMENT )
+	// A closed socket and the high-water mark are left to the regular send, which reports them per datagram.
+	if( ! mSocket->is_open() )
+		return false;
+	// The syscall goes out straight away, while asio sends in order behind anything it still has queued.
+	if( mPendingSends )
+		return false;
+	size_t size = 0;
+	for( auto i = begin; i < end; i++ )
+		size += datagrams[i]->size();
+	if( ! isWithinHighWaterMark( end - begin, size ) )
+		return false;
+	
+	segmentBuffer.clear();
+	for( auto i = begin; i < end; i++ )
+		segmentBuffer.insert( segmentBuffer.end(), datagrams[i]->begin() + 4, datagrams[i]->end() );
+	
+	iovec iov;
+	iov.iov_base = segmentBuffer.data();
+	iov.iov_len = segmentBuffer.size();
+	
+	union {
+		char buffer[CMSG_SPACE( sizeof( uint16_t ) )];
+		cmsghdr align;
+	} control;
+	memset( &control, 0, sizeof( control ) );
+	
+	msghdr msg;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.msg_name = mRemoteEndpoint.data();
+	msg.msg_namelen = mRemoteEndpoint.size();
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof( control.buffer );
+	
+	auto cmsg = CMSG_FIRSTHDR( &msg );
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+	uint16_t gsoSize = segmentSize;
+	memcpy( CMSG_DATA( cmsg ), &gsoSize, sizeof( gsoSize ) );
+	
+	auto sent = ::sendmsg( mSocket->native_handle(), &msg, 0 );
+	if( sent >= 0 ) {
+		// The datagrams are gone already, but complete on the io_service like any other send.
+		auto inFlight = trackInFlight( end - begin, size, nullptr );
+		std::vector<SendCompletionFn> run( completions.begin() + begin, completions.begin() + end );
+		getIoService().post( [inFlight, run] {
+			inFlight( asio::error_code() );
+			for( auto & completion : run ) {
+				if( completion )
+					completion( asio::error_code() );
+			}
+		});
+		return true;
+	}
+	
+	// EIO means the device can't checksum the segments. EINVAL comes from kernels that don't know the option
+	// as well as from segments larger than the path mtu, so either way there's no point trying again. Anything
+	// else, like EAGAIN while asio holds the socket non-blocking, only concerns this burst.
+	if( errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP )
+		mSegmentationOffloadSupported = false;
+	return false;
+#else
+	return false;
+#endif
+}
+
 void SenderUdp::closeImpl()
 {
 	asio::error_code ec;
@@ -987,19 +1574,37 @@ void SenderUdp::closeImpl()
 
 SenderTcp::SenderTcp( uint16_t localPort, const string &destinationHost, uint16_t destinationPort, PacketFramingRef packetFraming, const protocol &protocol, io_service &service )
 : SenderBase( packetFraming ), mSocket( new tcp::socket( service ) ), mLocalEndpoint( protocol, localPort ),
-	mRemoteEndpoint( tcp::endpoint( address::from_string( destinationHost ), destinationPort ) )
+	mRemoteEndpoint( tcp::endpoint( address::from_string( destinationHost ), destinationPort ) ),
+	mWriteInProgress( false ), mLatencyPolicy( LatencyPolicy::DEFAULT ), mFlushInterval( 0 ),
+	mFlushRequested( false ), mFlushTimerArmed( false ), mSendBufferSize( 0 ),
+	mAutoReconnectEnabled( false ), mConnectRequested( false ), mWatchingConnection( false ), mConnected( false ),
+	mConnectionId( 0 ), mReconnectDelay( 0 ), mBufferedHead( 0 ), mBufferedCount( 0 ), mBufferedBytes( 0 ), mWatchByte( 0 )
 {
 }
 	
 SenderTcp::SenderTcp( uint16_t localPort, const protocol::endpoint &destination, PacketFramingRef packetFraming, const protocol &protocol, io_service &service )
 : SenderBase( packetFraming ), mSocket( new tcp::socket( service ) ), mLocalEndpoint( protocol, localPort ),
-	mRemoteEndpoint( destination )
+	mRemoteEndpoint( destination ), mWriteInProgress( false ), mLatencyPolicy( LatencyPolicy::DEFAULT ),
+	mFlushInterval( 0 ), mFlushRequested( false ), mFlushTimerArmed( false ), mSendBufferSize( 0 ),
+	mAutoReconnectEnabled( false ), mConnectRequested( false ), mWatchingConnection( false ), mConnected( false ),
+	mConnectionId( 0 ), mReconnectDelay( 0 ), mBufferedHead( 0 ), mBufferedCount( 0 ), mBufferedBytes( 0 ), mWatchByte( 0 )
 {
 }
 	
 SenderTcp::SenderTcp( const TcpSocketRef &socket, const protocol::endpoint &destination, PacketFramingRef packetFraming )
-: SenderBase( packetFraming ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mRemoteEndpoint( destination )
+: SenderBase( packetFraming ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mRemoteEndpoint( destination ),
+	mWriteInProgress( false ), mLatencyPolicy( LatencyPolicy::DEFAULT ), mFlushInterval( 0 ),
+	mFlushRequested( false ), mFlushTimerArmed( false ), mSendBufferSize( 0 ),
+	mAutoReconnectEnabled( false ), mConnectRequested( false ), mWatchingConnection( false ), mConnected( false ),
+	mConnectionId( 0 ), mReconnectDelay( 0 ), mBufferedHead( 0 ), mBufferedCount( 0 ), mBufferedBytes( 0 ), mWatchByte( 0 )
+{
+	// The socket is already bound, so bindImpl won't get to apply the options.
+	applySocketOptions();
+}
+
+SenderTcp::~SenderTcp()
 {
+	detachPacingTimer();
 }
 	
 void SenderTcp::bindImpl()
@@ -1010,127 +1615,1334 @@ void SenderTcp::bindImpl()
 		handleError( ec, "" );
 		return;
 	}
+	// Reconnecting rebinds the same local endpoint, which may still be in TIME_WAIT.
+	if( mAutoReconnectEnabled )
+		mSocket->set_option( asio::socket_base::reuse_address( true ), ec );
 	mSocket->bind( mLocalEndpoint, ec );
-	if( ec )
+	if( ec ) {
 		handleError( ec, "" );
+		return;
+	}
+	applySocketOptions();
 }
 	
 void SenderTcp::connect()
 {
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mConnectRequested = true;
+	}
 	mSocket->async_connect( mRemoteEndpoint,
 	[&]( const asio::error_code &error ){
-		if( error )
-			handleError( error, "" );
+		handleConnect( error );
 	});
 }
 
-void SenderTcp::sendImpl( const ByteBufferRef &data )
+void SenderTcp::handleConnect( const asio::error_code &error )
 {
-	ByteBufferRef transportData = data;
-	if( mPacketFraming )
-		transportData = mPacketFraming->encode( data );
-	mSocket->async_send( asio::buffer( *transportData ),
-	// copy data pointer to persist the asynchronous send
-	[&, transportData]( const asio::error_code& error, size_t bytesTransferred )
+	if( error ) {
+		handleError( error, "" );
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		if( mAutoReconnectEnabled && mConnectRequested && error != asio::error::operation_aborted )
+			scheduleReconnect();
+		return;
+	}
+	
+	std::vector<QueuedWrite> dropped;
+	bool watch = false;
+	uint64_t connectionId;
 	{
-		if( error ) {
-			// derive oscAddress
-			std::string oscAddress;
-			auto foundBegin = find( transportData->begin(), transportData->end(), (uint8_t)'/' );
-			if( foundBegin != transportData->end() ) {
-				auto foundEnd = find( foundBegin, transportData->end(), 0 );
-				oscAddress = std::string( foundBegin, foundEnd );
-			}
-			handleError( error, oscAddress );
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mConnected = true;
+		connectionId = ++mConnectionId;
+		mReconnectDelay = mReconnectOptions.initialDelay;
+		if( mReconnectOptions.policy == ReconnectPolicy::REPLAY )
+			takeBufferedWrites( mQueuedWrites );
+		else
+			takeBufferedWrites( dropped );
+		if( ! mQueuedWrites.empty() ) {
+			// Replayed writes aren't corked, they've waited long enough.
+			mFlushRequested = true;
+			if( ! mWriteInProgress )
+				writeQueued();
 		}
-	});
+		if( mAutoReconnectEnabled && ! mWatchingConnection ) {
+			mWatchingConnection = true;
+			watch = true;
+		}
+	}
+	completeWrites( dropped, asio::error::not_connected );
+	if( watch )
+		watchConnection( connectionId );
 }
-	
-void SenderTcp::closeImpl()
+
+void SenderTcp::handleDisconnect( std::vector<QueuedWrite> &dropped )
 {
+	mConnected = false;
+	// Invalidates the handlers still pending on the old connection.
+	mConnectionId++;
+	if( ! mAutoReconnectEnabled )
+		return;
+	
+	// Corked writes haven't touched the socket yet, so they can still go out after reconnecting.
+	for( auto & write : mQueuedWrites )
+		bufferWrite( std::move( write ), dropped );
+	mQueuedWrites.clear();
 	asio::error_code ec;
 	mSocket->close( ec );
-	if( ec )
-		handleError( ec, "" );
+	if( mConnectRequested )
+		scheduleReconnect();
 }
-	
-/////////////////////////////////////////////////////////////////////////////////////////
-//// ReceiverBase
-	
-void ReceiverBase::setListener( const std::string &address, ListenerFn listener )
-{
-	std::lock_guard<std::mutex> lock( mListenerMutex );
-	auto foundListener = std::find_if( mListeners.begin(), mListeners.end(),
-	[address]( const std::pair<std::string, ListenerFn> &listener ) {
-		  return address == listener.first;
+
+void SenderTcp::scheduleReconnect()
+{
+	auto delay = mReconnectDelay;
+	mReconnectDelay = std::min( mReconnectOptions.maxDelay,
+		std::chrono::milliseconds( int64_t( delay.count() * mReconnectOptions.backoffMultiplier ) ) );
+	mReconnectTimer->expires_from_now( delay );
+	mReconnectTimer->async_wait(
+	[&]( const asio::error_code &error ) {
+		if( error == asio::error::operation_aborted )
+			return;
+		{
+			std::lock_guard<std::mutex> lock( mWriteMutex );
+			if( ! mAutoReconnectEnabled || ! mConnectRequested || mConnected )
+				return;
+		}
+		// A socket that failed to connect can't be reused, so start over from a fresh one.
+		asio::error_code ec;
+		mSocket->close( ec );
+		bindImpl();
+		mSocket->async_connect( mRemoteEndpoint,
+		[&]( const asio::error_code &error ){
+			handleConnect( error );
+		});
 	});
-	if( foundListener != mListeners.end() ) {
-		foundListener->second = listener;
-	}
-	else {
-		mListeners.push_back( { address, listener } );
-	}
 }
 
-void ReceiverBase::removeListener( const std::string &address )
+void SenderTcp::watchConnection( uint64_t connectionId )
 {
-	std::lock_guard<std::mutex> lock( mListenerMutex );
-	auto foundListener = std::find_if( mListeners.begin(), mListeners.end(),
-	[address]( const std::pair<std::string, ListenerFn> &listener ) {
-		  return address == listener.first;
+	mSocket->async_read_some( asio::buffer( &mWatchByte, 1 ),
+	[&, connectionId]( const asio::error_code &error, size_t bytesTransferred ) {
+		// Nothing is expected from the peer, anything it does send is discarded.
+		if( ! error ) {
+			watchConnection( connectionId );
+			return;
+		}
+		
+		std::vector<QueuedWrite> dropped;
+		{
+			std::lock_guard<std::mutex> lock( mWriteMutex );
+			mWatchingConnection = false;
+			if( connectionId != mConnectionId )
+				return;
+			handleDisconnect( dropped );
+		}
+		handleError( error, "" );
+		postCompleteWrites( dropped, asio::error::no_buffer_space );
 	});
-	if( foundListener != mListeners.end() ) {
-		mListeners.erase( foundListener );
-	}
 }
 
-void ReceiverBase::dispatchMethods( uint8_t *data, uint32_t size )
+void SenderTcp::setAutoReconnect( const ReconnectOptions &options )
 {
-	std::vector<Message> messages;
-	decodeData( data, size, messages );
-	if( messages.empty() ) return;
-	
-	std::lock_guard<std::mutex> lock( mListenerMutex );
-	// iterate through all the messages and find matches with registered methods
-	for( auto & message : messages ) {
-		bool dispatchedOnce = false;
-		for( auto & listener : mListeners ) {
-			if( patternMatch( message.getAddress(), listener.first ) ) {
-				listener.second( message );
-				dispatchedOnce = true;
-			}
-		}
-		if( ! dispatchedOnce ) {
-			CI_LOG_W("Message: " << message.getAddress() << " doesn't have a listener. Disregarding.");
+	std::vector<QueuedWrite> dropped;
+	bool watch = false;
+	uint64_t connectionId;
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		std::vector<QueuedWrite> buffered;
+		takeBufferedWrites( buffered );
+		mReconnectOptions = options;
+		mBufferedWrites.clear();
+		mBufferedWrites.resize( options.maxBufferedMessages );
+		for( auto & write : buffered )
+			bufferWrite( std::move( write ), dropped );
+		// Replaying moves the whole ring to the write queue at once.
+		mQueuedWrites.reserve( options.maxBufferedMessages );
+		
+		mAutoReconnectEnabled = true;
+		mReconnectDelay = options.initialDelay;
+		if( ! mReconnectTimer )
+			mReconnectTimer.reset( new asio::steady_timer( getIoService() ) );
+		if( mConnected && ! mWatchingConnection ) {
+			mWatchingConnection = true;
+			watch = true;
 		}
+		connectionId = mConnectionId;
 	}
+	postCompleteWrites( dropped, asio::error::no_buffer_space );
+	if( watch )
+		watchConnection( connectionId );
 }
-	
-bool ReceiverBase::decodeData( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag ) const
+
+void SenderTcp::disableAutoReconnect()
 {
-	if( ! memcmp( data, "#bundle\0", 8 ) ) {
-		data += 8; size -= 8;
-		
-		uint64_t timestamp;
-		memcpy( &timestamp, data, 8 ); data += 8; size -= 8;
-		
-		while( size != 0 ) {
-			uint32_t seg_size;
-			memcpy( &seg_size, data, 4 );
-			data += 4; size -= 4;
-			
-			seg_size = ntohl( seg_size );
-			if( seg_size > size ) {
-				CI_LOG_E( "Problem Parsing Bundle: Segment Size is greater than bundle size." );
-				return false;
-			}
-			if( !decodeData( data, seg_size, messages, ntohll( timestamp ) ) )
-				return false;
-			
-			data += seg_size; size -= seg_size;
-		}
+	std::vector<QueuedWrite> dropped;
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mAutoReconnectEnabled = false;
+		if( mReconnectTimer )
+			mReconnectTimer->cancel();
+		takeBufferedWrites( dropped );
 	}
-	else {
+	completeWrites( dropped, asio::error::not_connected );
+}
+
+size_t SenderTcp::getBufferedCount() const
+{
+	std::lock_guard<std::mutex> lock( mWriteMutex );
+	return mBufferedCount;
+}
+
+void SenderTcp::bufferWrite( QueuedWrite &&write, std::vector<QueuedWrite> &dropped )
+{
+	auto capacity = mBufferedWrites.size();
+	auto size = write.data->size();
+	if( capacity == 0 || size > mReconnectOptions.maxBufferedBytes ) {
+		dropped.push_back( std::move( write ) );
+		return;
+	}
+	while( mBufferedCount == capacity || mBufferedBytes + size > mReconnectOptions.maxBufferedBytes ) {
+		auto &oldest = mBufferedWrites[mBufferedHead];
+		mBufferedBytes -= oldest.data->size();
+		dropped.push_back( std::move( oldest ) );
+		mBufferedHead = ( mBufferedHead + 1 ) % capacity;
+		mBufferedCount--;
+	}
+	mBufferedWrites[( mBufferedHead + mBufferedCount ) % capacity] = std::move( write );
+	mBufferedCount++;
+	mBufferedBytes += size;
+}
+
+void SenderTcp::takeBufferedWrites( std::vector<QueuedWrite> &writes )
+{
+	auto capacity = mBufferedWrites.size();
+	for( size_t i = 0; i < mBufferedCount; i++ )
+		writes.push_back( std::move( mBufferedWrites[( mBufferedHead + i ) % capacity] ) );
+	mBufferedHead = 0;
+	mBufferedCount = 0;
+	mBufferedBytes = 0;
+}
+
+void SenderTcp::completeWrites( std::vector<QueuedWrite> &writes, const asio::error_code &error )
+{
+	for( auto & write : writes )
+		write.onComplete( error );
+	recycleFrameBuffers( writes );
+}
+
+void SenderTcp::postCompleteWrites( std::vector<QueuedWrite> &writes, const asio::error_code &error )
+{
+	if( writes.empty() )
+		return;
+	auto posted = std::make_shared<std::vector<QueuedWrite>>( std::move( writes ) );
+	writes.clear();
+	getIoService().post( [this, posted, error] {
+		completeWrites( *posted, error );
+	});
+}
+
+ByteBufferRef SenderTcp::acquireFrameBuffer()
+{
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		if( ! mFramePool.empty() ) {
+			auto buffer = std::move( mFramePool.back() );
+			mFramePool.pop_back();
+			return buffer;
+		}
+	}
+	return ByteBufferRef( new ByteBuffer );
+}
+
+void SenderTcp::recycleFrameBuffers( std::vector<QueuedWrite> &writes )
+{
+	// Unframed sends write the message's own buffer, which isn't ours to reuse.
+	if( mPacketFraming && ! writes.empty() ) {
+		// Enough to cover a typical batch without holding on to every buffer of a burst.
+		const size_t maxPoolSize = 256;
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		for( auto & write : writes ) {
+			if( mFramePool.size() == maxPoolSize )
+				break;
+			if( write.data && write.data.use_count() == 1 )
+				mFramePool.push_back( std::move( write.data ) );
+		}
+	}
+	writes.clear();
+}
+
+void SenderTcp::sendImpl( const ByteBufferRef &data, SendCompletionFn onComplete )
+{
+	ByteBufferRef transportData = data;
+	if( mPacketFraming ) {
+		// buffers in this system begin with the size, which will be removed in the case of Packet Framing.
+		auto packet = data->data() + 4;
+		auto packetSize = data->size() - 4;
+		transportData = acquireFrameBuffer();
+		mPacketFraming->encodeFrame( packet, packetSize, *transportData );
+	}
+	
+	std::vector<QueuedWrite> dropped;
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		if( mAutoReconnectEnabled && ! mConnected ) {
+			// Held until handleConnect replays or drops it.
+			bufferWrite( { transportData, std::move( onComplete ) }, dropped );
+		}
+		else {
+			mQueuedWrites.push_back( { transportData, std::move( onComplete ) } );
+			if( mLatencyPolicy == LatencyPolicy::THROUGHPUT && ! mFlushRequested ) {
+				if( mFlushInterval.count() > 0 && ! mFlushTimerArmed ) {
+					mFlushTimerArmed = true;
+					mFlushTimer->expires_from_now( mFlushInterval );
+					mFlushTimer->async_wait(
+					[&]( const asio::error_code &error ) {
+						if( error == asio::error::operation_aborted )
+							return;
+						{
+							std::lock_guard<std::mutex> lock( mWriteMutex );
+							mFlushTimerArmed = false;
+						}
+						flush();
+					});
+				}
+			}
+			// Interleaving writes would corrupt the stream's framing, so queue behind the one in flight.
+			else if( ! mWriteInProgress )
+				writeQueued();
+		}
+	}
+	postCompleteWrites( dropped, asio::error::no_buffer_space );
+}
+
+void SenderTcp::flush()
+{
+	std::lock_guard<std::mutex> lock( mWriteMutex );
+	if( mQueuedWrites.empty() )
+		return;
+	// If a write is in flight, its completion picks up the queue.
+	mFlushRequested = true;
+	if( ! mWriteInProgress )
+		writeQueued();
+}
+
+void SenderTcp::setLatencyPolicy( LatencyPolicy policy, std::chrono::milliseconds flushInterval )
+{
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mLatencyPolicy = policy;
+		mFlushInterval = flushInterval;
+		if( ! mFlushTimer )
+			mFlushTimer.reset( new asio::steady_timer( getIoService() ) );
+		if( mFlushTimerArmed ) {
+			mFlushTimer->cancel();
+			mFlushTimerArmed = false;
+		}
+	}
+	applySocketOptions();
+	// applySocketOptions leaves Nagle alone under DEFAULT, so undo an earlier LOW_LATENCY here.
+	if( policy == LatencyPolicy::DEFAULT && mSocket->is_open() ) {
+		asio::error_code ec;
+		mSocket->set_option( asio::ip::tcp::no_delay( false ), ec );
+		if( ec )
+			handleError( ec, "" );
+	}
+	// Nothing stays corked once latency matters again.
+	if( policy != LatencyPolicy::THROUGHPUT )
+		flush();
+}
+
+void SenderTcp::setSendBufferSize( int bytes )
+{
+	mSendBufferSize = bytes;
+	applySocketOptions();
+}
+
+void SenderTcp::applySocketOptions()
+{
+	if( ! mSocket->is_open() )
+		return;
+	asio::error_code ec;
+	auto policy = mLatencyPolicy.load();
+	if( policy != LatencyPolicy::DEFAULT ) {
+		mSocket->set_option( asio::ip::tcp::no_delay( policy == LatencyPolicy::LOW_LATENCY ), ec );
+		if( ec )
+			handleError( ec, "" );
+	}
+	if( mSendBufferSize > 0 ) {
+		mSocket->set_option( asio::socket_base::send_buffer_size( mSendBufferSize ), ec );
+		if( ec )
+			handleError( ec, "" );
+	}
+}
+
+void SenderTcp::writeQueued()
+{
+	mFlushRequested = false;
+	mActiveWrites.swap( mQueuedWrites );
+	mWriteBuffers.clear();
+	for( auto & write : mActiveWrites )
+		mWriteBuffers.push_back( asio::buffer( *write.data ) );
+	mWriteInProgress = true;
+	
+	auto connectionId = mConnectionId;
+	asio::async_write( *mSocket, mWriteBuffers,
+	[&, connectionId]( const asio::error_code &error, size_t bytesTransferred )
+	{
+		std::vector<QueuedWrite> completed, dropped;
+		{
+			std::lock_guard<std::mutex> lock( mWriteMutex );
+			completed.swap( mActiveWrites );
+			// The batch may have been partially written, so it's completed with the error rather than replayed.
+			if( error && connectionId == mConnectionId )
+				handleDisconnect( dropped );
+			bool corked = mLatencyPolicy == LatencyPolicy::THROUGHPUT && ! mFlushRequested;
+			if( ! mQueuedWrites.empty() && ! corked )
+				writeQueued();
+			else
+				mWriteInProgress = false;
+		}
+		
+		for( auto & write : completed ) {
+			if( error ) {
+				// derive oscAddress
+				std::string oscAddress;
+				auto foundBegin = find( write.data->begin(), write.data->end(), (uint8_t)'/' );
+				if( foundBegin != write.data->end() ) {
+					auto foundEnd = find( foundBegin, write.data->end(), 0 );
+					oscAddress = std::string( foundBegin, foundEnd );
+				}
+				handleError( error, oscAddress );
+			}
+			write.onComplete( error );
+		}
+		recycleFrameBuffers( completed );
+		postCompleteWrites( dropped, asio::error::no_buffer_space );
+	});
+}
+	
+void SenderTcp::closeImpl()
+{
+	std::vector<QueuedWrite> dropped;
+	{
+		std::lock_guard<std::mutex> lock( mWriteMutex );
+		mConnectRequested = false;
+		mConnected = false;
+		mConnectionId++;
+		if( mReconnectTimer )
+			mReconnectTimer->cancel();
+		takeBufferedWrites( dropped );
+	}
+	completeWrites( dropped, asio::error::operation_aborted );
+	
+	asio::error_code ec;
+	mSocket->close( ec );
+	if( ec )
+		handleError( ec, "" );
+}
+	
+/////////////////////////////////////////////////////////////////////////////////////////
+//// PatternMatcher
+
+PatternMatcher::PatternMatcher( const std::string &pattern )
+: mPattern( pattern )
+{
+	auto appendLiteral = [&]( const char *data, size_t size ) {
+		if( mTokens.empty() || mTokens.back().mType != Token::Type::LITERAL )
+			mTokens.emplace_back( Token::Type::LITERAL );
+		mTokens.back().mLiteral.append( data, size );
+	};
+	
+	size_t i = 0;
+	while( i < pattern.size() ) {
+		char c = pattern[i];
+		if( c == '?' ) {
+			mTokens.emplace_back( Token::Type::ANY );
+			i++;
+		}
+		else if( c == '*' ) {
+			// consecutive stars match the same as one
+			if( mTokens.empty() || mTokens.back().mType != Token::Type::ANY_RUN )
+				mTokens.emplace_back( Token::Type::ANY_RUN );
+			i++;
+		}
+		else if( c == '[' && pattern.find( ']', i + 1 ) != std::string::npos ) {
+			auto close = pattern.find( ']', i + 1 );
+			Token token( Token::Type::SET );
+			size_t j = i + 1;
+			bool negate = j < close && pattern[j] == '!';
+			if( negate )
+				j++;
+			while( j < close ) {
+				// a '-' between two characters is a range, anywhere else it's literal
+				if( j + 2 < close && pattern[j + 1] == '-' ) {
+					auto first = uint8_t( pattern[j] ), last = uint8_t( pattern[j + 2] );
+					if( first > last )
+						std::swap( first, last );
+					for( int k = first; k <= last; k++ )
+						token.mSet.set( k );
+					j += 3;
+				}
+				else {
+					token.mSet.set( uint8_t( pattern[j++] ) );
+				}
+			}
+			if( negate )
+				token.mSet.flip();
+			token.mSet.reset( '/' );
+			mTokens.push_back( std::move( token ) );
+			i = close + 1;
+		}
+		else if( c == '{' && pattern.find( '}', i + 1 ) != std::string::npos ) {
+			auto close = pattern.find( '}', i + 1 );
+			Token token( Token::Type::ALTERNATIVES );
+			size_t j = i + 1;
+			while( true ) {
+				auto comma = std::min( pattern.find( ',', j ), close );
+				token.mAlternatives.push_back( pattern.substr( j, comma - j ) );
+				if( comma == close )
+					break;
+				j = comma + 1;
+			}
+			mTokens.push_back( std::move( token ) );
+			i = close + 1;
+		}
+		else {
+			auto special = std::min( pattern.find_first_of( "?*[{", i + 1 ), pattern.size() );
+			appendLiteral( pattern.data() + i, special - i );
+			i = special;
+		}
+	}
+	
+	if( mTokens.empty() || ( mTokens.size() == 1 && mTokens[0].mType == Token::Type::LITERAL ) )
+		mKind = Kind::LITERAL;
+	else if( mTokens.back().mType == Token::Type::ANY_RUN &&
+			( mTokens.size() == 1 || ( mTokens.size() == 2 && mTokens[0].mType == Token::Type::LITERAL ) ) )
+		mKind = Kind::PREFIX;
+	else
+		mKind = Kind::GLOB;
+}
+
+bool PatternMatcher::match( const char *data, size_t size ) const
+{
+	switch( mKind ) {
+		case Kind::LITERAL:
+			return size == mPattern.size() && memcmp( data, mPattern.data(), size ) == 0;
+		case Kind::PREFIX: {
+			size_t length = 0;
+			if( mTokens.size() == 2 ) {
+				length = mTokens[0].mLiteral.size();
+				if( size < length || memcmp( data, mTokens[0].mLiteral.data(), length ) != 0 )
+					return false;
+			}
+			return ! memchr( data + length, '/', size - length );
+		}
+		case Kind::GLOB:
+		default:
+			return matchTokens( 0, data, size );
+	}
+}
+
+bool PatternMatcher::matchTokens( size_t token, const char *data, size_t size ) const
+{
+	for( ; token < mTokens.size(); token++ ) {
+		auto &current = mTokens[token];
+		switch( current.mType ) {
+			case Token::Type::LITERAL: {
+				auto length = current.mLiteral.size();
+				if( size < length || memcmp( data, current.mLiteral.data(), length ) != 0 )
+					return false;
+				data += length; size -= length;
+			}
+				break;
+			case Token::Type::ANY:
+				if( size == 0 || *data == '/' )
+					return false;
+				data++; size--;
+				break;
+			case Token::Type::SET:
+				if( size == 0 || ! current.mSet.test( uint8_t( *data ) ) )
+					return false;
+				data++; size--;
+				break;
+			case Token::Type::ALTERNATIVES:
+				for( auto & alternative : current.mAlternatives ) {
+					auto length = alternative.size();
+					if( size >= length && memcmp( data, alternative.data(), length ) == 0 &&
+						matchTokens( token + 1, data + length, size - length ) )
+						return true;
+				}
+				return false;
+			case Token::Type::ANY_RUN: {
+				if( token + 1 == mTokens.size() )
+					return ! memchr( data, '/', size );
+				// try every split of the run against the rest, a run never crosses a '/'
+				auto &next = mTokens[token + 1];
+				for( size_t i = 0; i <= size; i++ ) {
+					if( ( next.mType != Token::Type::LITERAL || ( i < size && data[i] == next.mLiteral[0] ) ) &&
+						matchTokens( token + 1, data + i, size - i ) )
+						return true;
+					if( i < size && data[i] == '/' )
+						return false;
+				}
+				return false;
+			}
+		}
+	}
+	return size == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//// LatencyHistogram
+
+size_t LatencyHistogram::getBucket( uint64_t value )
+{
+	// the top five bits of the value pick the bucket within its power of two
+	size_t shift = 0;
+	while( ( value >> shift ) >= 2 * kSubBuckets )
+		shift++;
+	return shift * kSubBuckets + size_t( value >> shift );
+}
+
+uint64_t LatencyHistogram::getBucketMax( size_t bucket )
+{
+	if( bucket < 2 * kSubBuckets )
+		return bucket;
+	auto shift = bucket / kSubBuckets - 1;
+	auto mantissa = uint64_t( bucket - shift * kSubBuckets );
+	return ( ( mantissa + 1 ) << shift ) - 1;
+}
+
+void LatencyHistogram::record( std::chrono::nanoseconds value )
+{
+	auto nanoseconds = uint64_t( std::max<int64_t>( value.count(), 0 ) );
+	mBuckets[getBucket( nanoseconds )].fetch_add( 1, std::memory_order_relaxed );
+	mCount.fetch_add( 1, std::memory_order_relaxed );
+	mTotal.fetch_add( nanoseconds, std::memory_order_relaxed );
+	auto max = mMax.load( std::memory_order_relaxed );
+	while( nanoseconds > max && ! mMax.compare_exchange_weak( max, nanoseconds, std::memory_order_relaxed ) );
+}
+
+std::chrono::nanoseconds LatencyHistogram::getPercentile( double percentile ) const
+{
+	auto count = getCount();
+	if( ! count )
+		return std::chrono::nanoseconds::zero();
+	// the rank of the value asked for, rounded up
+	auto exact = std::min( std::max( percentile, 0.0 ), 1.0 ) * count;
+	auto rank = std::max<uint64_t>( uint64_t( exact ) + ( uint64_t( exact ) < exact ? 1 : 0 ), 1 );
+	uint64_t seen = 0;
+	for( size_t bucket = 0; bucket < kNumBuckets; bucket++ ) {
+		seen += mBuckets[bucket].load( std::memory_order_relaxed );
+		if( seen >= rank )
+			return std::chrono::nanoseconds( std::min( getBucketMax( bucket ), mMax.load( std::memory_order_relaxed ) ) );
+	}
+	return getMax();
+}
+
+std::chrono::nanoseconds LatencyHistogram::getMean() const
+{
+	auto count = getCount();
+	return std::chrono::nanoseconds( count ? mTotal.load( std::memory_order_relaxed ) / count : 0 );
+}
+
+void LatencyHistogram::reset()
+{
+	for( auto & bucket : mBuckets )
+		bucket.store( 0, std::memory_order_relaxed );
+	mCount = 0;
+	mTotal = 0;
+	mMax = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//// ReceiverBase
+	
+ReceiverBase::ReceiverBase( PacketFramingRef packetFraming )
+: mDispatchSwitching( false ), mDispatchOverflowCount( 0 ), mQueueOverflowCount( 0 ), mConflatedCount( 0 ), mAddressRateTopN( 0 ), mLatencyTracking( false ), mPacketFraming( packetFraming )
+{
+	mListenerTable = makeListenerTable( std::make_shared<ListenerNode>() );
+}
+
+ReceiverBase::~ReceiverBase()
+{
+	// stops the ticker first, its deliveries call the listeners too
+	mConflationTicker.reset();
+	// finishes dispatching anything already queued before the listeners go away
+	std::atomic_store( &mDispatchExecutor, std::shared_ptr<DispatchExecutor>() );
+}
+
+void ReceiverBase::setListener( const std::string &address, ListenerFn listener )
+{
+	std::lock_guard<std::mutex> lock( mListenerMutex );
+	auto table = std::atomic_load( &mListenerTable );
+	auto root = setListenerNode( table->mRoot.get(), address, 0, listener, mListenerSequence++ );
+	std::atomic_store( &mListenerTable, makeListenerTable( std::move( root ) ) );
+}
+
+void ReceiverBase::removeListener( const std::string &address )
+{
+	std::lock_guard<std::mutex> lock( mListenerMutex );
+	auto table = std::atomic_load( &mListenerTable );
+	auto root = removeListenerNode( table->mRoot, address, 0 );
+	if( root == table->mRoot )
+		return;
+	if( ! root )
+		root = std::make_shared<ListenerNode>();
+	std::atomic_store( &mListenerTable, makeListenerTable( std::move( root ) ) );
+}
+
+void ReceiverBase::setDispatchCacheSize( size_t size )
+{
+	std::lock_guard<std::mutex> lock( mListenerMutex );
+	mDispatchCacheSize = size;
+	auto table = std::atomic_load( &mListenerTable );
+	std::atomic_store( &mListenerTable, makeListenerTable( table->mRoot ) );
+}
+
+const size_t ReceiverBase::DispatchCache::kNumProbes;
+
+ReceiverBase::ListenerTableRef ReceiverBase::makeListenerTable( ListenerNodeRef root ) const
+{
+	std::unique_ptr<DispatchCache> cache;
+	if( mDispatchCacheSize > 0 )
+		cache.reset( new DispatchCache( std::max( mDispatchCacheSize, DispatchCache::kNumProbes ) ) );
+	return ListenerTableRef( new ListenerTable{ std::move( root ), std::move( cache ) } );
+}
+
+void ReceiverBase::setDispatchThreads( size_t numThreads, size_t maxQueued, QueueOverflowPolicy policy )
+{
+	std::lock_guard<std::mutex> lock( mDispatchExecutorMutex );
+	std::shared_ptr<DispatchExecutor> executor;
+	if( numThreads )
+		executor = std::make_shared<DispatchExecutor>( this, numThreads, std::max<size_t>( maxQueued, 1 ), policy );
+	auto previous = std::atomic_load( &mDispatchExecutor );
+	if( previous )
+		mDispatchSwitching = true;
+	std::atomic_store( &mDispatchExecutor, executor );
+	if( previous ) {
+		// dispatches that took it before the swap may still be posting to it, the last to let go
+		// wakes us, see releaseDispatchExecutor
+		std::atomic_thread_fence( std::memory_order_seq_cst );
+		{
+			std::unique_lock<std::mutex> switchLock( mDispatchSwitchMutex );
+			mDispatchSwitchCondition.wait( switchLock, [&previous] { return previous.use_count() == 1; } );
+		}
+		// runs what's queued and joins the workers
+		previous.reset();
+		{
+			std::lock_guard<std::mutex> switchLock( mDispatchSwitchMutex );
+			mDispatchSwitching = false;
+		}
+		mDispatchSwitchCondition.notify_all();
+	}
+	if( executor )
+		executor->start();
+}
+
+size_t ReceiverBase::getDispatchThreads() const
+{
+	auto executor = std::atomic_load( &mDispatchExecutor );
+	auto numThreads = executor ? executor->getNumThreads() : 0;
+	releaseDispatchExecutor( executor );
+	return numThreads;
+}
+
+void ReceiverBase::releaseDispatchExecutor( std::shared_ptr<DispatchExecutor> &executor ) const
+{
+	if( ! executor )
+		return;
+	executor.reset();
+	// pairs with the fence in setDispatchThreads: either it sees this reference gone, or this sees
+	// it switching and wakes it
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( mDispatchSwitching ) {
+		std::lock_guard<std::mutex> switchLock( mDispatchSwitchMutex );
+		mDispatchSwitchCondition.notify_all();
+	}
+}
+
+ReceiverBase::ListenerNodeRef ReceiverBase::setListenerNode( const ListenerNode *node, const std::string &address, size_t position, const ListenerFn &listener, uint64_t sequence )
+{
+	// copy the node on the path, its children are shared with the previous snapshot
+	auto copy = node ? std::make_shared<ListenerNode>( *node ) : std::make_shared<ListenerNode>();
+	if( position == std::string::npos ) {
+		// replacing a listener keeps its place in the dispatch order
+		if( ! copy->mListener )
+			copy->mSequence = sequence;
+		copy->mListener = listener;
+		return copy;
+	}
+	
+	auto end = address.find( '/', position );
+	auto segment = address.substr( position, end == std::string::npos ? std::string::npos : end - position );
+	auto next = end == std::string::npos ? end : end + 1;
+	
+	PatternMatcher matcher( segment );
+	if( matcher.isLiteral() ) {
+		auto &child = copy->mLiterals[std::move( segment )];
+		child = setListenerNode( child.get(), address, next, listener, sequence );
+	}
+	else {
+		auto found = std::find_if( copy->mPatterns.begin(), copy->mPatterns.end(),
+		[&segment]( const std::pair<PatternMatcher, ListenerNodeRef> &pattern ) {
+			return pattern.first.getPattern() == segment;
+		});
+		if( found == copy->mPatterns.end() )
+			found = copy->mPatterns.emplace( copy->mPatterns.end(), std::move( matcher ), nullptr );
+		found->second = setListenerNode( found->second.get(), address, next, listener, sequence );
+	}
+	return copy;
+}
+
+ReceiverBase::ListenerNodeRef ReceiverBase::removeListenerNode( const ListenerNodeRef &node, const std::string &address, size_t position )
+{
+	std::shared_ptr<ListenerNode> copy;
+	if( position == std::string::npos ) {
+		if( ! node->mListener )
+			return node;
+		copy = std::make_shared<ListenerNode>( *node );
+		copy->mListener = nullptr;
+	}
+	else {
+		auto end = address.find( '/', position );
+		auto segment = address.substr( position, end == std::string::npos ? std::string::npos : end - position );
+		auto next = end == std::string::npos ? end : end + 1;
+		
+		if( ! PatternMatcher( segment ).isLiteral() ) {
+			auto found = std::find_if( node->mPatterns.begin(), node->mPatterns.end(),
+			[&segment]( const std::pair<PatternMatcher, ListenerNodeRef> &pattern ) {
+				return pattern.first.getPattern() == segment;
+			});
+			if( found == node->mPatterns.end() )
+				return node;
+			auto child = removeListenerNode( found->second, address, next );
+			if( child == found->second )
+				return node;
+			copy = std::make_shared<ListenerNode>( *node );
+			auto index = found - node->mPatterns.begin();
+			if( child )
+				copy->mPatterns[index].second = std::move( child );
+			else
+				copy->mPatterns.erase( copy->mPatterns.begin() + index );
+		}
+		else {
+			auto found = node->mLiterals.find( segment );
+			if( found == node->mLiterals.end() )
+				return node;
+			auto child = removeListenerNode( found->second, address, next );
+			if( child == found->second )
+				return node;
+			copy = std::make_shared<ListenerNode>( *node );
+			if( child )
+				copy->mLiterals[segment] = std::move( child );
+			else
+				copy->mLiterals.erase( segment );
+		}
+	}
+	// prune nodes left without a listener or children
+	if( ! copy->mListener && copy->mLiterals.empty() && copy->mPatterns.empty() )
+		return nullptr;
+	return copy;
+}
+
+void ReceiverBase::dispatchMethods( uint8_t *data, uint32_t size, std::chrono::nanoseconds receiveTime )
+{
+	mStatsCounters.mPackets++;
+	mStatsCounters.mBytes += size;
+	
+	std::vector<Message> messages;
+	decodeData( data, size, messages );
+	if( messages.empty() ) return;
+	
+	mStatsCounters.mMessages += messages.size();
+	if( mAddressRateTopN.load( std::memory_order_relaxed ) )
+		trackAddresses( messages );
+	if( receiveTime != std::chrono::nanoseconds::zero() ) {
+		for( auto & message : messages )
+			message.mReceiveTime = receiveTime;
+	}
+	if( mLatencyTracking.load( std::memory_order_relaxed ) ) {
+		for( auto & message : messages )
+			recordOneWayLatency( message );
+	}
+	
+	// conflated messages wait in their slot for the consumer, the rest carry on
+	auto rules = std::atomic_load( &mConflationRules );
+	if( rules ) {
+		messages.erase( std::remove_if( messages.begin(), messages.end(),
+		[&]( Message &message ) {
+			return conflate( *rules, message );
+		}), messages.end() );
+		if( messages.empty() ) return;
+	}
+	
+	// queued messages are matched with listeners by the consuming thread
+	auto queue = std::atomic_load( &mMessageQueue );
+	if( queue ) {
+		std::lock_guard<std::mutex> lock( queue->mProducerMutex );
+		for( auto & message : messages )
+			queueMessage( *queue, std::move( message ) );
+		return;
+	}
+	
+	// hold on to the current snapshot, no lock is held while the listeners run
+	auto table = std::atomic_load( &mListenerTable );
+	auto executor = std::atomic_load( &mDispatchExecutor );
+	// the previous workers are finishing their queues, which dispatching here would overtake
+	if( ! executor && mDispatchSwitching ) {
+		std::unique_lock<std::mutex> switchLock( mDispatchSwitchMutex );
+		mDispatchSwitchCondition.wait( switchLock, [this] { return ! mDispatchSwitching; } );
+	}
+	// iterate through all the messages and find matches with registered methods
+	for( auto & message : messages ) {
+		auto matches = resolveListeners( *table, message.getAddress() );
+		if( matches->empty() ) {
+			reportUnmatched( message );
+			continue;
+		}
+		if( executor ) {
+			auto hash = std::hash<std::string>()( message.getAddress() );
+			executor->post( hash, { std::move( message ), table, std::move( matches ) } );
+		}
+		else {
+			callListeners( message, *matches );
+		}
+	}
+	releaseDispatchExecutor( executor );
+}
+
+void ReceiverBase::callListeners( const Message &message, const std::vector<ListenerMatch> &matches )
+{
+	if( mLatencyTracking.load( std::memory_order_relaxed ) && message.mReceiveTime != std::chrono::nanoseconds::zero() )
+		mDispatchDelay.record( std::chrono::system_clock::now().time_since_epoch() - message.mReceiveTime );
+	for( auto & match : matches )
+		( *match.second )( message );
+}
+
+void ReceiverBase::queueMessage( MessageQueue &queue, Message &&message )
+{
+	// a queue that's been replaced won't be drained again
+	if( queue.mClosed ) {
+		mQueueOverflowCount++;
+		return;
+	}
+	while( ! queue.mRing.tryPush( std::move( message ) ) ) {
+		if( queue.mPolicy == QueueOverflowPolicy::DROP_NEWEST || queue.mClosed ) {
+			mQueueOverflowCount++;
+			return;
+		}
+		std::this_thread::yield();
+	}
+}
+
+void ReceiverBase::setMessageQueue( size_t capacity, QueueOverflowPolicy policy )
+{
+	std::shared_ptr<MessageQueue> queue;
+	std::unique_lock<std::mutex> queueLock;
+	if( capacity ) {
+		queue = std::make_shared<MessageQueue>( capacity, policy );
+		// receiving threads wait until the previous queue's messages are in, ahead of theirs
+		queueLock = std::unique_lock<std::mutex>( queue->mProducerMutex );
+	}
+	auto previous = std::atomic_exchange( &mMessageQueue, queue );
+	if( ! previous )
+		return;
+	previous->mClosed = true;
+	// waits out a receiving thread still pushing onto it, and a consumer taking from it
+	std::lock_guard<std::mutex> producerLock( previous->mProducerMutex );
+	std::lock_guard<std::mutex> consumerLock( previous->mConsumerMutex );
+	Message message;
+	while( previous->mRing.tryPop( message ) ) {
+		if( ! queue || ! queue->mRing.tryPush( std::move( message ) ) )
+			mQueueOverflowCount++;
+	}
+}
+
+size_t ReceiverBase::drain()
+{
+	auto table = std::atomic_load( &mListenerTable );
+	return drain( [&]( const Message &message ) {
+		auto matches = resolveListeners( *table, message.getAddress() );
+		if( matches->empty() ) {
+			reportUnmatched( message );
+			return;
+		}
+		callListeners( message, *matches );
+	});
+}
+
+size_t ReceiverBase::drain( const ListenerFn &fn )
+{
+	auto queue = std::atomic_load( &mMessageQueue );
+	if( ! queue )
+		return 0;
+	std::lock_guard<std::mutex> lock( queue->mConsumerMutex );
+	// only drain what's there now, so a fast producer can't keep the consumer here
+	auto available = queue->mRing.size();
+	size_t count = 0;
+	Message message;
+	while( count < available && queue->mRing.tryPop( message ) ) {
+		fn( message );
+		count++;
+	}
+	return count;
+}
+
+size_t ReceiverBase::poll( std::vector<Message> &messages, size_t maxMessages )
+{
+	auto queue = std::atomic_load( &mMessageQueue );
+	if( ! queue )
+		return 0;
+	std::lock_guard<std::mutex> lock( queue->mConsumerMutex );
+	size_t count = 0;
+	Message message;
+	while( count < maxMessages && queue->mRing.tryPop( message ) ) {
+		messages.push_back( std::move( message ) );
+		count++;
+	}
+	return count;
+}
+
+struct ReceiverBase::ConflationTicker {
+	ConflationTicker( ReceiverBase *receiver, std::chrono::microseconds interval )
+	: mStopping( false )
+	{
+		mThread = std::thread( [this, receiver, interval] {
+			// ticks are scheduled from the start, so slow deliveries don't make the interval drift
+			auto tick = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> lock( mMutex );
+			while( true ) {
+				tick += interval;
+				if( mCondition.wait_until( lock, tick, [this] { return mStopping; } ) )
+					return;
+				lock.unlock();
+				receiver->deliverConflated();
+				lock.lock();
+			}
+		});
+	}
+	~ConflationTicker()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mStopping = true;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+	
+	std::mutex				mMutex;
+	std::condition_variable	mCondition;
+	bool					mStopping;
+	std::thread				mThread;
+};
+
+void ReceiverBase::setConflation( const std::string &addressPattern, ConflationKey key )
+{
+	std::lock_guard<std::mutex> lock( mListenerMutex );
+	auto current = std::atomic_load( &mConflationRules );
+	auto rules = current ? std::make_shared<std::vector<ConflationRule>>( *current ) : std::make_shared<std::vector<ConflationRule>>();
+	auto found = std::find_if( rules->begin(), rules->end(),
+	[&addressPattern]( const ConflationRule &rule ) {
+		return rule.mMatcher.getPattern() == addressPattern;
+	});
+	if( found != rules->end() )
+		found->mKey = key;
+	else
+		rules->push_back( { PatternMatcher( addressPattern ), key } );
+	std::atomic_store( &mConflationRules, ConflationRulesRef( std::move( rules ) ) );
+}
+
+void ReceiverBase::removeConflation( const std::string &addressPattern )
+{
+	{
+		std::lock_guard<std::mutex> lock( mListenerMutex );
+		auto current = std::atomic_load( &mConflationRules );
+		if( ! current )
+			return;
+		auto rules = std::make_shared<std::vector<ConflationRule>>( *current );
+		rules->erase( std::remove_if( rules->begin(), rules->end(),
+		[&addressPattern]( const ConflationRule &rule ) {
+			return rule.mMatcher.getPattern() == addressPattern;
+		}), rules->end() );
+		std::atomic_store( &mConflationRules, rules->empty() ? nullptr : ConflationRulesRef( std::move( rules ) ) );
+	}
+	// ADDRESS slots only outlive their delivery under a PATTERN key, which is the pattern itself.
+	// A pending one is still listed for delivery, which frees it.
+	std::lock_guard<std::mutex> lock( mConflationMutex );
+	auto found = mConflationSlots.find( addressPattern );
+	if( found == mConflationSlots.end() )
+		return;
+	if( found->second.mPending )
+		found->second.mRelease = true;
+	else
+		mConflationSlots.erase( found );
+}
+
+bool ReceiverBase::conflate( const std::vector<ConflationRule> &rules, Message &message )
+{
+	auto &address = message.getAddress();
+	auto rule = std::find_if( rules.begin(), rules.end(),
+	[&address]( const ConflationRule &rule ) {
+		return rule.mMatcher.match( address );
+	});
+	if( rule == rules.end() )
+		return false;
+	
+	auto &key = rule->mKey == ConflationKey::ADDRESS ? address : rule->mMatcher.getPattern();
+	std::lock_guard<std::mutex> lock( mConflationMutex );
+	auto found = mConflationSlots.find( key );
+	if( found == mConflationSlots.end() )
+		found = mConflationSlots.emplace( key, ConflationSlot() ).first;
+	auto &slot = found->second;
+	if( slot.mPending )
+		mConflatedCount++;
+	else {
+		slot.mPending = true;
+		slot.mRelease = rule->mKey == ConflationKey::ADDRESS;
+		mConflationPending.push_back( &*found );
+	}
+	slot.mMessage = std::move( message );
+	return true;
+}
+
+size_t ReceiverBase::deliverConflated()
+{
+	auto table = std::atomic_load( &mListenerTable );
+	return deliverConflated( [&]( const Message &message ) {
+		auto matches = resolveListeners( *table, message.getAddress() );
+		if( matches->empty() ) {
+			reportUnmatched( message );
+			return;
+		}
+		callListeners( message, *matches );
+	});
+}
+
+size_t ReceiverBase::deliverConflated( const ListenerFn &fn )
+{
+	// take the newest messages out of their slots, the receiving thread only waits on the moves
+	std::vector<Message> messages;
+	{
+		std::lock_guard<std::mutex> lock( mConflationMutex );
+		messages.reserve( mConflationPending.size() );
+		for( auto entry : mConflationPending ) {
+			messages.push_back( std::move( entry->second.mMessage ) );
+			if( entry->second.mRelease )
+				mConflationSlots.erase( entry->first );
+			else
+				entry->second.mPending = false;
+		}
+		mConflationPending.clear();
+	}
+	for( auto & message : messages )
+		fn( message );
+	return messages.size();
+}
+
+void ReceiverBase::setConflationInterval( std::chrono::microseconds interval )
+{
+	std::lock_guard<std::mutex> lock( mConflationTickerMutex );
+	mConflationTicker.reset();
+	if( interval.count() > 0 )
+		mConflationTicker.reset( new ConflationTicker( this, interval ) );
+}
+
+ReceiverBase::DispatchExecutor::DispatchExecutor( ReceiverBase *receiver, size_t numThreads, size_t maxQueued, QueueOverflowPolicy policy )
+: mReceiver( receiver ), mMaxQueued( maxQueued ), mPolicy( policy )
+{
+	for( size_t i = 0; i < numThreads; i++ ) {
+		mWorkers.emplace_back( new Worker );
+		auto worker = mWorkers.back().get();
+		worker->mThread = std::thread( [this, worker] { run( *worker ); } );
+	}
+}
+
+ReceiverBase::DispatchExecutor::~DispatchExecutor()
+{
+	for( auto & worker : mWorkers ) {
+		std::lock_guard<std::mutex> lock( worker->mMutex );
+		worker->mStarted = true;
+		worker->mStopping = true;
+		worker->mCondition.notify_one();
+	}
+	for( auto & worker : mWorkers )
+		worker->mThread.join();
+}
+
+void ReceiverBase::DispatchExecutor::start()
+{
+	for( auto & worker : mWorkers ) {
+		std::lock_guard<std::mutex> lock( worker->mMutex );
+		worker->mStarted = true;
+		worker->mCondition.notify_one();
+	}
+}
+
+void ReceiverBase::DispatchExecutor::post( size_t hash, DispatchTask &&task )
+{
+	auto &worker = *mWorkers[hash % mWorkers.size()];
+	std::unique_lock<std::mutex> lock( worker.mMutex );
+	if( worker.mTasks.size() >= mMaxQueued ) {
+		if( mPolicy == QueueOverflowPolicy::DROP_NEWEST ) {
+			mReceiver->mDispatchOverflowCount++;
+			return;
+		}
+		worker.mSpace.wait( lock, [&] { return worker.mTasks.size() < mMaxQueued; } );
+	}
+	worker.mTasks.push_back( std::move( task ) );
+	if( worker.mTasks.size() == 1 )
+		worker.mCondition.notify_one();
+}
+
+void ReceiverBase::DispatchExecutor::run( Worker &worker )
+{
+	std::deque<DispatchTask> tasks;
+	while( true ) {
+		{
+			std::unique_lock<std::mutex> lock( worker.mMutex );
+			worker.mCondition.wait( lock, [&worker] {
+				return worker.mStopping || ( worker.mStarted && ! worker.mTasks.empty() );
+			});
+			if( worker.mTasks.empty() )
+				return;
+			// take everything queued at once, so posting only contends once per batch
+			tasks.swap( worker.mTasks );
+			worker.mSpace.notify_all();
+		}
+		for( auto & task : tasks )
+			mReceiver->callListeners( task.mMessage, *task.mMatches );
+		tasks.clear();
+	}
+}
+
+ReceiverBase::ListenerMatchesRef ReceiverBase::resolveListeners( const ListenerTable &table, const std::string &address )
+{
+	auto cache = table.mCache.get();
+	size_t hash = 0, first = 0;
+	if( cache ) {
+		hash = std::hash<std::string>()( address );
+		first = hash % cache->mSlots.size();
+		for( size_t i = 0; i < DispatchCache::kNumProbes; i++ ) {
+			auto &slot = cache->mSlots[( first + i ) % cache->mSlots.size()];
+			auto entry = slot.mEntry.load( std::memory_order_acquire );
+			if( entry && entry->mHash == hash && entry->mAddress == address ) {
+				// skips the store when it's already set, so hot entries don't bounce their cache line
+				if( ! slot.mReferenced.load( std::memory_order_relaxed ) )
+					slot.mReferenced.store( true, std::memory_order_relaxed );
+				return entry->mMatches;
+			}
+		}
+	}
+	
+	auto matches = std::make_shared<std::vector<ListenerMatch>>();
+	findListeners( *table.mRoot, address, 0, *matches );
+	// matches come from different branches of the tree, call them in the order they were set
+	if( matches->size() > 1 )
+		std::sort( matches->begin(), matches->end(),
+		[]( const ListenerMatch &lhs, const ListenerMatch &rhs ) {
+			return lhs.first < rhs.first;
+		});
+	if( ! cache )
+		return matches;
+	
+	bool full = false;
+	{
+		std::lock_guard<std::mutex> lock( cache->mMutex );
+		DispatchCache::Slot *victim = nullptr;
+		for( size_t i = 0; i < DispatchCache::kNumProbes; i++ ) {
+			auto &slot = cache->mSlots[( first + i ) % cache->mSlots.size()];
+			auto entry = slot.mEntry.load( std::memory_order_relaxed );
+			// another thread resolved it in the meantime
+			if( entry && entry->mHash == hash && entry->mAddress == address )
+				return matches;
+			if( ! entry && ! victim )
+				victim = &slot;
+		}
+		// The window is full, so the hand sweeps it clearing referenced bits until it finds one clear. Hits
+		// on other threads may set them again, so after two sweeps it takes whichever slot it's at.
+		for( size_t i = 0; ! victim; i++ ) {
+			auto &slot = cache->mSlots[( first + cache->mHand++ % DispatchCache::kNumProbes ) % cache->mSlots.size()];
+			if( slot.mReferenced.exchange( false, std::memory_order_relaxed ) && i < 2 * DispatchCache::kNumProbes )
+				continue;
+			victim = &slot;
+		}
+		cache->mEntries.emplace_back( new DispatchCache::Entry{ hash, address, matches } );
+		victim->mReferenced.store( false, std::memory_order_relaxed );
+		victim->mEntry.store( cache->mEntries.back().get(), std::memory_order_release );
+		full = cache->mEntries.size() >= 4 * cache->mSlots.size();
+	}
+	// Replaced entries can't be freed while a lookup may be reading them, so once they've piled up the
+	// snapshot is republished with an empty cache, and the old one goes when its last dispatch is done.
+	if( full ) {
+		std::unique_lock<std::mutex> lock( mListenerMutex, std::try_to_lock );
+		auto current = std::atomic_load( &mListenerTable );
+		if( lock && current.get() == &table )
+			std::atomic_store( &mListenerTable, makeListenerTable( current->mRoot ) );
+	}
+	return matches;
+}
+
+void ReceiverBase::findListeners( const ListenerNode &node, const std::string &address, size_t position, std::vector<ListenerMatch> &matches ) const
+{
+	if( position == std::string::npos ) {
+		if( node.mListener )
+			matches.emplace_back( node.mSequence, &node.mListener );
+		return;
+	}
+	
+	auto end = address.find( '/', position );
+	auto segmentSize = ( end == std::string::npos ? address.size() : end ) - position;
+	auto next = end == std::string::npos ? end : end + 1;
+	
+	if( ! node.mLiterals.empty() ) {
+		auto literal = node.mLiterals.find( address.substr( position, segmentSize ) );
+		if( literal != node.mLiterals.end() )
+			findListeners( *literal->second, address, next, matches );
+	}
+	// only descend into the pattern subtrees whose segment matches
+	for( auto & pattern : node.mPatterns ) {
+		if( pattern.first.match( address.data() + position, segmentSize ) )
+			findListeners( *pattern.second, address, next, matches );
+	}
+}
+	
+bool ReceiverBase::decodeData( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag )
+{
+	if( size >= 8 && ! memcmp( data, "#bundle\0", 8 ) ) {
+		if( size < 16 ) {
+			reportParseError( ParseError::BUNDLE_TOO_SHORT, "#bundle" );
+			return false;
+		}
+		mStatsCounters.mBundles++;
+		data += 8; size -= 8;
+		
+		uint64_t timestamp;
+		memcpy( &timestamp, data, 8 ); data += 8; size -= 8;
+		
+		while( size != 0 ) {
+			if( size < 4 ) {
+				reportParseError( ParseError::TRUNCATED, "#bundle" );
+				return false;
+			}
+			uint32_t seg_size;
+			memcpy( &seg_size, data, 4 );
+			data += 4; size -= 4;
+			
+			seg_size = ntohl( seg_size );
+			if( seg_size > size ) {
+				reportParseError( ParseError::BUNDLE_SEGMENT_TOO_LONG, "#bundle" );
+				return false;
+			}
+			if( !decodeData( data, seg_size, messages, ntohll( timestamp ) ) )
+				return false;
+			
+			data += seg_size; size -= seg_size;
+		}
+	}
+	else {
 		if( ! decodeMessage( data, size, messages, timetag ) )
 			return false;
 	}
@@ -1138,171 +2950,619 @@ bool ReceiverBase::decodeData( uint8_t *data, uint32_t size, std::vector<Message
 	return true;
 }
 
-bool ReceiverBase::decodeMessage( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag ) const
+bool ReceiverBase::decodeMessage( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag )
 {
 	Message message;
-	if( ! message.bufferCache( data, size ) )
+	ParseError error;
+	if( ! message.bufferCache( data, size, error ) ) {
+		reportParseError( error, message.getAddress() );
 		return false;
+	}
+	message.mBundleTimetag = timetag;
 	
 	messages.push_back( std::move( message ) );
 	return true;
 }
 
+void ReceiverBase::StatsCounters::reset()
+{
+	mPackets = mBytes = mMessages = mBundles = mUnmatchedMessages = mKernelDrops = 0;
+	for( auto & count : mParseErrors )
+		count = 0;
+}
+
+bool ReceiverBase::LogLimiter::allow( uint64_t &suppressed )
+{
+	auto now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	auto next = mNextLog.load( std::memory_order_relaxed );
+	// only the thread that moves the window on logs, the others count themselves as held back
+	if( now < next || ! mNextLog.compare_exchange_strong( next, now + 1000000000 ) ) {
+		mSuppressed++;
+		return false;
+	}
+	suppressed = mSuppressed.exchange( 0 );
+	return true;
+}
+
+static std::string getSuppressedNote( uint64_t suppressed )
+{
+	return suppressed ? " " + std::to_string( suppressed ) + " more since the last report." : std::string();
+}
+
+static const char* getParseErrorDescription( ParseError error )
+{
+	switch( error ) {
+		case ParseError::MISSING_ADDRESS: return "No address.";
+		case ParseError::MISSING_TYPE_TAGS: return "not properly formatted; no , separator.";
+		case ParseError::INCOMPLETE_TYPE_TAGS: return "not properly formatted; Types not complete.";
+		case ParseError::BLOB_TOO_LONG: return "not properly formatted; Blobs size is too long.";
+		case ParseError::BUNDLE_TOO_SHORT: return "Bundle is shorter than its header.";
+		case ParseError::BUNDLE_SEGMENT_TOO_LONG: return "Segment Size is greater than bundle size.";
+		case ParseError::TRUNCATED: return "Packet ends partway through an argument or segment size.";
+		default: return "Unknown error.";
+	}
+}
+
+void ReceiverBase::reportUnmatched( const Message &message )
+{
+	mStatsCounters.mUnmatchedMessages++;
+	uint64_t suppressed;
+	if( mUnmatchedLog.allow( suppressed ) )
+		CI_LOG_W("Message: " << message.getAddress() << " doesn't have a listener. Disregarding." << getSuppressedNote( suppressed ) );
+}
+
+void ReceiverBase::reportParseError( ParseError error, const std::string &address )
+{
+	mStatsCounters.mParseErrors[size_t( error )]++;
+	uint64_t suppressed;
+	if( mParseErrorLog.allow( suppressed ) )
+		CI_LOG_E( "Problem Parsing Packet with address [" << address << "]: " << getParseErrorDescription( error ) << getSuppressedNote( suppressed ) );
+}
+
+//! Returns this library's NTP time, seconds since 1900 above microseconds, as time since the Unix epoch.
+static std::chrono::nanoseconds getTimeSinceEpoch( uint64_t ntpTime )
+{
+	auto seconds = int64_t( ntpTime >> 32 ) - int64_t( 0x83AA7E80 );
+	auto microseconds = int64_t( ntpTime & uint32_t( ~0 ) );
+	return std::chrono::seconds( seconds ) + std::chrono::microseconds( microseconds );
+}
+
+void ReceiverBase::recordOneWayLatency( const Message &message )
+{
+	uint64_t sent = 0;
+	for( uint32_t i = 0; i < message.mDataViews.size(); i++ ) {
+		if( message.mDataViews[i].getType() == ArgType::TIME_TAG ) {
+			sent = uint64_t( message.getArgTime( i ) );
+			break;
+		}
+	}
+	// 1 is the bundle time tag meaning immediately
+	if( ! sent && message.mBundleTimetag > 1 )
+		sent = message.mBundleTimetag;
+	if( ! sent )
+		return;
+	
+	auto arrived = message.mReceiveTime != std::chrono::nanoseconds::zero() ? message.mReceiveTime : std::chrono::system_clock::now().time_since_epoch();
+	mOneWayLatency.record( std::chrono::duration_cast<std::chrono::nanoseconds>( arrived - getTimeSinceEpoch( sent ) ) );
+}
+
+void ReceiverBase::AddressRateTracker::count( const std::string &address, size_t capacity )
+{
+	auto found = mIndices.find( address );
+	if( found != mIndices.end() ) {
+		auto index = found->second;
+		mHeap[index].first++;
+		siftDown( index );
+	}
+	else if( mHeap.size() < capacity ) {
+		auto inserted = &*mIndices.emplace( address, mHeap.size() ).first;
+		mHeap.emplace_back( 1, inserted );
+		siftUp( mHeap.size() - 1 );
+	}
+	else {
+		// the least counted address is at the top, its replacement takes over its slot
+		mIndices.erase( mHeap[0].second->first );
+		auto inserted = &*mIndices.emplace( address, 0 ).first;
+		mHeap[0].first++;
+		mHeap[0].second = inserted;
+		siftDown( 0 );
+	}
+}
+
+void ReceiverBase::AddressRateTracker::clear()
+{
+	mIndices.clear();
+	mHeap.clear();
+}
+
+void ReceiverBase::AddressRateTracker::siftDown( size_t index )
+{
+	while( true ) {
+		auto least = index;
+		for( auto child = index * 2 + 1; child <= index * 2 + 2 && child < mHeap.size(); child++ ) {
+			if( mHeap[child].first < mHeap[least].first )
+				least = child;
+		}
+		if( least == index )
+			return;
+		std::swap( mHeap[index], mHeap[least] );
+		mHeap[index].second->second = index;
+		mHeap[least].second->second = least;
+		index = least;
+	}
+}
+
+void ReceiverBase::AddressRateTracker::siftUp( size_t index )
+{
+	while( index ) {
+		auto parent = ( index - 1 ) / 2;
+		if( mHeap[parent].first <= mHeap[index].first )
+			return;
+		std::swap( mHeap[index], mHeap[parent] );
+		mHeap[index].second->second = index;
+		mHeap[parent].second->second = parent;
+		index = parent;
+	}
+}
+
+void ReceiverBase::trackAddresses( const std::vector<Message> &messages )
+{
+	std::lock_guard<std::mutex> lock( mAddressRates.mMutex );
+	// a few times more slots than reported keeps the busiest addresses' counts close
+	auto capacity = mAddressRates.mTopN * 4;
+	if( ! capacity )
+		return;
+	for( auto & message : messages )
+		mAddressRates.count( message.getAddress(), capacity );
+}
+
+ReceiverBase::Stats ReceiverBase::getStats() const
+{
+	Stats stats;
+	stats.packets = mStatsCounters.mPackets;
+	stats.bytes = mStatsCounters.mBytes;
+	stats.messages = mStatsCounters.mMessages;
+	stats.bundles = mStatsCounters.mBundles;
+	for( size_t i = 0; i < stats.parseErrors.size(); i++ )
+		stats.parseErrors[i] = mStatsCounters.mParseErrors[i];
+	stats.unmatchedMessages = mStatsCounters.mUnmatchedMessages;
+	stats.kernelDrops = mStatsCounters.mKernelDrops;
+	
+	if( mAddressRateTopN ) {
+		std::vector<std::pair<std::string, uint64_t>> counts;
+		double seconds;
+		size_t topN;
+		{
+			std::lock_guard<std::mutex> lock( mAddressRates.mMutex );
+			for( auto & slot : mAddressRates.mHeap )
+				counts.emplace_back( slot.second->first, slot.first );
+			seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - mAddressRates.mStart ).count();
+			topN = mAddressRates.mTopN;
+		}
+		topN = std::min( topN, counts.size() );
+		std::partial_sort( counts.begin(), counts.begin() + topN, counts.end(),
+		[]( const std::pair<std::string, uint64_t> &lhs, const std::pair<std::string, uint64_t> &rhs ) {
+			return lhs.second > rhs.second;
+		});
+		for( size_t i = 0; i < topN; i++ )
+			stats.topAddresses.push_back( { std::move( counts[i].first ), seconds > 0 ? counts[i].second / seconds : 0 } );
+	}
+	return stats;
+}
+
+void ReceiverBase::resetStats()
+{
+	mStatsCounters.reset();
+	std::lock_guard<std::mutex> lock( mAddressRates.mMutex );
+	mAddressRates.clear();
+	mAddressRates.mStart = std::chrono::steady_clock::now();
+}
+
+void ReceiverBase::setAddressRateTracking( size_t topN )
+{
+	std::lock_guard<std::mutex> lock( mAddressRates.mMutex );
+	mAddressRates.mTopN = topN;
+	mAddressRates.clear();
+	mAddressRates.mStart = std::chrono::steady_clock::now();
+	mAddressRateTopN = topN;
+}
+
 bool ReceiverBase::patternMatch( const std::string& lhs, const std::string& rhs ) const
 {
-	bool negate = false;
-	bool mismatched = false;
-	std::string::const_iterator seq_tmp;
-	std::string::const_iterator seq = lhs.begin();
-	std::string::const_iterator seq_end = lhs.end();
-	std::string::const_iterator pattern = rhs.begin();
-	std::string::const_iterator pattern_end = rhs.end();
-	while( seq != seq_end && pattern != pattern_end ) {
-		switch( *pattern ) {
-			case '?':
-				break;
-			case '*': {
-				// if * is the last pattern, return true
-				if( ++pattern == pattern_end ) return true;
-				while( *seq != *pattern && seq != seq_end ) ++seq;
-				// if seq reaches to the end without matching pattern
-				if( seq == seq_end ) return false;
+	return PatternMatcher( rhs ).match( lhs );
+}
+	
+/////////////////////////////////////////////////////////////////////////////////////////
+//// ReceiverUdp
+	
+#if defined( OSC_HAS_RECVMMSG )
+struct ReceiverUdp::BatchReceiver {
+	//! Size of each datagram's slot, enough for the largest UDP payload.
+	static const size_t kDatagramSize = 65536;
+	
+	//! Sizes the slab for \a numDatagrams, reallocating only when that changes. The slab is left
+	//! uninitialized, so only the pages the kernel writes datagrams into are ever committed.
+	void prepare( size_t numDatagrams )
+	{
+		if( numDatagrams != mHeaders.size() ) {
+			mSlab.reset( new uint8_t[numDatagrams * kDatagramSize] );
+			mHeaders.resize( numDatagrams );
+			mVectors.resize( numDatagrams );
+			mNames.resize( numDatagrams );
+			mControls.resize( numDatagrams * kControlSize );
+			for( size_t i = 0; i < numDatagrams; i++ ) {
+				mVectors[i].iov_base = mSlab.get() + i * kDatagramSize;
+				mVectors[i].iov_len = kDatagramSize;
+				memset( &mHeaders[i], 0, sizeof( mmsghdr ) );
+				mHeaders[i].msg_hdr.msg_iov = &mVectors[i];
+				mHeaders[i].msg_hdr.msg_iovlen = 1;
+				mHeaders[i].msg_hdr.msg_name = &mNames[i];
 			}
-				break;
-			case '[': {
-				negate = false;
-				mismatched = false;
-				if( *( ++pattern ) == '!' ) {
-					negate = true;
-					++pattern;
-				}
-				if( *( pattern + 1 ) == '-' ) {
-					// range matching
-					char c_start = *pattern; ++pattern;
-					//assert(*pattern == '-');
-					char c_end = *( ++pattern ); ++pattern;
-					//assert(*pattern == ']');
-					// swap c_start and c_end if c_start is larger
-					if( c_start > c_end ) {
-						char tmp = c_start;
-						c_end = c_start;
-						c_start = tmp;
-					}
-					mismatched = ( c_start <= *seq && *seq <= c_end ) ? negate : !negate;
-					if( mismatched ) return false;
-				}
-				else {
-					// literal matching
-					while( *pattern != ']' ) {
-						if( *seq == *pattern ) {
-							mismatched = negate;
-							break;
-						}
-						++pattern;
-					}
-					if( mismatched ) return false;
-					while( *pattern != ']' ) ++pattern;
-				}
+		}
+		// the kernel overwrites these with what it received
+		for( size_t i = 0; i < mHeaders.size(); i++ ) {
+			mHeaders[i].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+			mHeaders[i].msg_hdr.msg_control = mControls.data() + i * kControlSize;
+			mHeaders[i].msg_hdr.msg_controllen = kControlSize;
+			mHeaders[i].msg_hdr.msg_flags = 0;
+		}
+	}
+	//! Reads the socket's drop count and the receive timestamp attached to \a header, leaving either
+	//! untouched if it isn't there.
+	static void readControl( msghdr &header, uint32_t &drops, std::chrono::nanoseconds &receiveTime )
+	{
+		for( auto control = CMSG_FIRSTHDR( &header ); control; control = CMSG_NXTHDR( &header, control ) ) {
+			if( control->cmsg_level != SOL_SOCKET )
+				continue;
+			if( control->cmsg_type == SO_RXQ_OVFL ) {
+				memcpy( &drops, CMSG_DATA( control ), sizeof( drops ) );
 			}
-				break;
-			case '{': {
-				seq_tmp = seq;
-				mismatched = true;
-				while( *( ++pattern ) != '}' ) {
-					// this assumes that there's no sequence like "{,a}" where ',' is
-					// follows immediately after '{', which is illegal.
-					if( *pattern == ',' ) {
-						mismatched = false;
-						break;
-					}
-					else if( *seq != *pattern ) {
-						// fast forward to the next ',' or '}'
-						while( *( ++pattern ) != ',' && *pattern != '}' );
-						if( *pattern == '}' ) return false;
-						// redo seq matching
-						seq = seq_tmp;
-						mismatched = true;
-					}
-					else {
-						// matched
-						++seq;
-						mismatched = false;
-					}
-				}
-				if( mismatched ) return false;
-				while( *pattern != '}' ) ++pattern;
-				--seq;
+			else if( control->cmsg_type == SCM_TIMESTAMPNS ) {
+				timespec time;
+				memcpy( &time, CMSG_DATA( control ), sizeof( time ) );
+				receiveTime = std::chrono::seconds( time.tv_sec ) + std::chrono::nanoseconds( time.tv_nsec );
 			}
-				break;
-			default: // non-special character
-				if( *seq != *pattern ) return false;
-				break;
 		}
-		++seq; ++pattern;
 	}
-	if( seq == seq_end && pattern == pattern_end ) return true;
-	else return false;
+	
+	static const size_t kControlSize = CMSG_SPACE( sizeof( uint32_t ) ) + CMSG_SPACE( sizeof( timespec ) );
+	
+	std::unique_ptr<uint8_t[]>		mSlab;
+	std::vector<mmsghdr>			mHeaders;
+	std::vector<iovec>				mVectors;
+	std::vector<sockaddr_storage>	mNames;
+	ByteBuffer						mControls;
+	//! The socket's drop count as of the last batch, the kernel's is cumulative.
+	uint32_t						mDrops = 0;
+};
+#else
+struct ReceiverUdp::BatchReceiver {
+};
+#endif
+
+ReceiverUdp::ReceiverUdp( uint16_t port, const asio::ip::udp &protocol, asio::io_service &service )
+: ReceiverBase( nullptr ), mSocket( new udp::socket( service ) ), mLocalEndpoint( protocol, port ), mAmountToReceive( 4096 ),
+	mBatchReceiveSize( 0 ), mReceiveTimestamps( false ), mTimestampOption( false )
+{
+}
+
+ReceiverUdp::ReceiverUdp( const asio::ip::udp::endpoint &localEndpoint, asio::io_service &io )
+: ReceiverBase( nullptr ), mSocket( new udp::socket( io ) ), mLocalEndpoint( localEndpoint ), mAmountToReceive( 4096 ),
+	mBatchReceiveSize( 0 ), mReceiveTimestamps( false ), mTimestampOption( false )
+{
+}
+
+ReceiverUdp::ReceiverUdp( UdpSocketRef socket )
+: ReceiverBase( nullptr ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mAmountToReceive( 4096 ),
+	mBatchReceiveSize( 0 ), mReceiveTimestamps( false ), mTimestampOption( false )
+{
+}
+
+ReceiverUdp::~ReceiverUdp() = default;
+
+bool ReceiverUdp::isBatchReceiveSupported()
+{
+#if defined( OSC_HAS_RECVMMSG )
+	return true;
+#else
+	return false;
+#endif
+}
+	
+void ReceiverUdp::bindImpl()
+{
+	// a new socket needs its options set and starts its drop count over
+	mBatchReceiver.reset();
+	mTimestampOption = false;
+	asio::error_code ec;
+	mSocket->open( mLocalEndpoint.protocol(), ec );
+	if( ec ) {
+		handleError( ec, protocol::endpoint() );
+		return;
+	}
+	mSocket->bind( mLocalEndpoint, ec );
+	if( ec )
+		handleError( ec, protocol::endpoint() );
+}
+
+void ReceiverUdp::setTimestampOption( bool enable )
+{
+	mTimestampOption = enable;
+#if defined( OSC_HAS_RECEIVE_TIMESTAMPS )
+	int value = enable ? 1 : 0;
+	if( ::setsockopt( mSocket->native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof( value ) ) )
+		handleError( asio::error_code( errno, asio::error::get_system_category() ), protocol::endpoint() );
+#endif
+}
+
+std::chrono::nanoseconds ReceiverUdp::getLastReceiveTime()
+{
+	if( ! mReceiveTimestamps )
+		return std::chrono::nanoseconds::zero();
+	return std::chrono::system_clock::now().time_since_epoch();
+}
+
+void ReceiverUdp::listenImpl()
+{
+#if defined( OSC_HAS_RECVMMSG )
+	// one datagram at a time goes through recvmmsg too, which hands over the kernel's drop count and
+	// timestamps along with it
+	if( mReceiveTimestamps != mTimestampOption )
+		setTimestampOption( mReceiveTimestamps );
+	if( ! mBatchReceiver ) {
+		mBatchReceiver.reset( new BatchReceiver );
+		// has the kernel attach its drop count to each datagram it queues from now on
+		int enable = 1;
+		::setsockopt( mSocket->native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof( enable ) );
+	}
+	listenBatched();
+#else
+	// sized once for the largest datagram, so nothing is ever truncated or needs guessing
+	if( mReceiveBuffer.empty() )
+		mReceiveBuffer.resize( 65535 );
+	mSocket->async_receive_from( asio::buffer( mReceiveBuffer ), mRemoteEndpoint,
+	[&]( const asio::error_code &error, size_t bytesTransferred ) {
+		if( error == asio::error::operation_aborted )
+			return;
+		if( error )
+			handleError( error, mRemoteEndpoint );
+		else
+			dispatchMethods( mReceiveBuffer.data(), static_cast<uint32_t>( bytesTransferred ), getLastReceiveTime() );
+		listen();
+	});
+#endif
+}
+	
+void ReceiverUdp::listenBatched()
+{
+	// wait for readability rather than a datagram, so the whole batch comes from one recvmmsg
+	mSocket->async_receive( asio::null_buffers(),
+	[&]( const asio::error_code &error, size_t /*bytesTransferred*/ ) {
+		if( error == asio::error::operation_aborted )
+			return;
+		if( error ) {
+			handleError( error, protocol::endpoint() );
+		}
+		else {
+			// a full batch likely left more datagrams behind, which are received straight away as asio's
+			// speculative receive would, up to a bound so the thread's other handlers still get to run
+			for( size_t i = 0; i < kMaxBatchesPerWakeup && receiveBatch() && mSocket->is_open(); i++ )
+				;
+		}
+		listen();
+	});
+}
+
+bool ReceiverUdp::receiveBatch()
+{
+#if defined( OSC_HAS_RECVMMSG )
+	auto &batch = *mBatchReceiver;
+	batch.prepare( std::max<size_t>( mBatchReceiveSize, 1 ) );
+	
+	// MSG_TRUNC has the kernel report the full length of a datagram that didn't fit
+	auto received = ::recvmmsg( mSocket->native_handle(), batch.mHeaders.data(), static_cast<unsigned int>( batch.mHeaders.size() ), MSG_DONTWAIT | MSG_TRUNC, nullptr );
+	if( received < 0 ) {
+		// another receive on the socket may have taken the datagrams since it became readable
+		if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+			handleError( asio::error_code( errno, asio::error::get_system_category() ), protocol::endpoint() );
+		return false;
+	}
+	
+	for( int i = 0; i < received; i++ ) {
+		auto &header = batch.mHeaders[i];
+		// only an IPv6 jumbogram could be larger than a slot
+		if( header.msg_hdr.msg_flags & MSG_TRUNC ) {
+			protocol::endpoint originator;
+			memcpy( originator.data(), &batch.mNames[i], std::min<size_t>( header.msg_hdr.msg_namelen, originator.capacity() ) );
+			handleError( asio::error::message_size, originator );
+			continue;
+		}
+		// the drop count is cumulative, so the latest one covers every datagram before it
+		auto drops = batch.mDrops;
+		auto receiveTime = std::chrono::nanoseconds::zero();
+		BatchReceiver::readControl( header.msg_hdr, drops, receiveTime );
+		if( drops != batch.mDrops ) {
+			countKernelDrops( uint32_t( drops - batch.mDrops ) );
+			batch.mDrops = drops;
+		}
+		dispatchMethods( batch.mSlab.get() + i * BatchReceiver::kDatagramSize, header.msg_len, receiveTime );
+	}
+	return size_t( received ) == batch.mHeaders.size();
+#else
+	return false;
+#endif
+}
+
+void ReceiverUdp::setSocketErrorFn( SocketTransportErrorFn<protocol> errorFn )
+{
+	std::lock_guard<std::mutex> lock( mSocketTransportErrorFnMutex );
+	mSocketTransportErrorFn = errorFn;
+}
+	
+void ReceiverUdp::handleError( const asio::error_code &error, const protocol::endpoint &originator )
+{
+	std::lock_guard<std::mutex> lock( mSocketTransportErrorFnMutex );
+	if( mSocketTransportErrorFn ) {
+		mSocketTransportErrorFn( error, originator );
+	}
+	else {
+		CI_LOG_E( error.message() << ", didn't receive message from " << originator.address().to_string() );
+	}
+}
+	
+/////////////////////////////////////////////////////////////////////////////////////////
+//// ReceiverUdpGroup
+
+ReceiverUdpGroup::ReceiverUdpGroup( uint16_t port, size_t numSockets, const protocol &protocol )
+: ReceiverUdpGroup( protocol::endpoint( protocol, port ), numSockets )
+{
+}
+
+ReceiverUdpGroup::ReceiverUdpGroup( const protocol::endpoint &localEndpoint, size_t numSockets )
+: ReceiverBase( nullptr ), mLocalEndpoint( localEndpoint ), mNumSockets( isSupported() ? std::max<size_t>( numSockets, 1 ) : 1 ),
+	mPreserveSourceOrder( true ), mBatchReceiveSize( 0 ), mReceiveTimestamps( false )
+{
+	for( size_t i = 0; i < mNumSockets; i++ ) {
+		mThreads.emplace_back( new MemberThread );
+		auto thread = mThreads.back().get();
+		thread->mWork.reset( new asio::io_service::work( thread->mService ) );
+		thread->mThread = std::thread( [thread] { thread->mService.run(); } );
+	}
+}
+
+ReceiverUdpGroup::~ReceiverUdpGroup()
+{
+	closeImpl();
+	for( auto & thread : mThreads ) {
+		thread->mWork.reset();
+		thread->mService.stop();
+		thread->mThread.join();
+	}
+}
+
+bool ReceiverUdpGroup::isSupported()
+{
+#if defined( OSC_HAS_REUSEPORT )
+	return true;
+#else
+	return false;
+#endif
 }
+
+void ReceiverUdpGroup::bindImpl()
+{
+	closeImpl();
 	
-/////////////////////////////////////////////////////////////////////////////////////////
-//// ReceiverUdp
+	auto endpoint = mLocalEndpoint;
+	UdpSocketRef first;
+	for( auto & thread : mThreads ) {
+		auto socket = std::make_shared<udp::socket>( thread->mService );
+		asio::error_code ec;
+		socket->open( endpoint.protocol(), ec );
+		if( ec ) {
+			handleError( ec, endpoint );
+			return;
+		}
+#if defined( OSC_HAS_REUSEPORT )
+		int enable = 1;
+		if( setsockopt( socket->native_handle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof( enable ) ) ) {
+			handleError( asio::error_code( errno, asio::error::get_system_category() ), endpoint );
+			return;
+		}
+#endif
+		socket->bind( endpoint, ec );
+		if( ec ) {
+			handleError( ec, endpoint );
+			return;
+		}
+		// the rest of the group joins whatever port the first socket was given
+		if( ! first ) {
+			first = socket;
+			endpoint = mLocalEndpoint = socket->local_endpoint();
+		}
+		
+		thread->mReceiver.reset( new Member( this, socket ) );
+		thread->mReceiver->setBatchReceiveSize( mBatchReceiveSize );
+		thread->mReceiver->setReceiveTimestamps( mReceiveTimestamps );
+		thread->mReceiver->setSocketErrorFn(
+		[this]( const asio::error_code &error, const protocol::endpoint &originator ) {
+			handleError( error, originator );
+		});
+	}
 	
-ReceiverUdp::ReceiverUdp( uint16_t port, const asio::ip::udp &protocol, asio::io_service &service )
-: ReceiverBase( nullptr ), mSocket( new udp::socket( service ) ), mLocalEndpoint( protocol, port ), mAmountToReceive( 4096 )
-{
+	if( ! mPreserveSourceOrder && mThreads.size() > 1 )
+		attachRandomBalancer( first );
 }
 
-ReceiverUdp::ReceiverUdp( const asio::ip::udp::endpoint &localEndpoint, asio::io_service &io )
-: ReceiverBase( nullptr ), mSocket( new udp::socket( io ) ), mLocalEndpoint( localEndpoint ), mAmountToReceive( 4096 )
+void ReceiverUdpGroup::listenImpl()
 {
+	for( auto & thread : mThreads ) {
+		auto receiver = thread->mReceiver.get();
+		if( receiver )
+			thread->mService.post( [receiver] { receiver->listen(); } );
+	}
 }
 
-ReceiverUdp::ReceiverUdp( UdpSocketRef socket )
-: ReceiverBase( nullptr ), mSocket( socket ), mLocalEndpoint( socket->local_endpoint() ), mAmountToReceive( 4096 )
-{
+void ReceiverUdpGroup::closeImpl()
+{
+	for( auto & thread : mThreads ) {
+		if( ! thread->mReceiver )
+			continue;
+		// close on the socket's own thread, and wait for the aborted receive to run before the
+		// receiver it refers to goes away
+		auto receiver = thread->mReceiver.get();
+		std::promise<void> closed;
+		thread->mService.post( [receiver] { receiver->close(); } );
+		thread->mService.post( [&closed] { closed.set_value(); } );
+		closed.get_future().wait();
+		thread->mReceiver.reset();
+	}
 }
-	
-void ReceiverUdp::bindImpl()
+
+void ReceiverUdpGroup::setBatchReceiveSize( size_t maxDatagrams )
 {
-	asio::error_code ec;
-	mSocket->open( mLocalEndpoint.protocol(), ec );
-	if( ec ) {
-		handleError( ec, protocol::endpoint() );
-		return;
+	mBatchReceiveSize = maxDatagrams;
+	for( auto & thread : mThreads ) {
+		auto receiver = thread->mReceiver.get();
+		if( receiver )
+			thread->mService.post( [receiver, maxDatagrams] { receiver->setBatchReceiveSize( maxDatagrams ); } );
 	}
-	mSocket->bind( mLocalEndpoint, ec );
-	if( ec )
-		handleError( ec, protocol::endpoint() );
 }
 
-void ReceiverUdp::listenImpl()
+void ReceiverUdpGroup::setReceiveTimestamps( bool enable )
 {
-	auto tempBuffer = mBuffer.prepare( mAmountToReceive );
-	auto uniqueEndpoint = std::make_shared<asio::ip::udp::endpoint>();
-	mSocket->async_receive_from( tempBuffer, *uniqueEndpoint,
-	[&, uniqueEndpoint]( const asio::error_code &error, size_t bytesTransferred ) {
-		if( error ) {
-			handleError( error, *uniqueEndpoint );
-		}
-		else {
-			mBuffer.commit( bytesTransferred );
-			auto data = std::unique_ptr<uint8_t[]>( new uint8_t[ bytesTransferred + 1 ] );
-			data[ bytesTransferred ] = 0;
-			istream stream( &mBuffer );
-			stream.read( reinterpret_cast<char*>( data.get() ), bytesTransferred );
-			dispatchMethods( data.get(), bytesTransferred );
-		}
-		listen();
-	});
+	mReceiveTimestamps = enable;
+	for( auto & thread : mThreads ) {
+		auto receiver = thread->mReceiver.get();
+		if( receiver )
+			thread->mService.post( [receiver, enable] { receiver->setReceiveTimestamps( enable ); } );
+	}
 }
-	
-void ReceiverUdp::setSocketErrorFn( SocketTransportErrorFn<protocol> errorFn )
+
+void ReceiverUdpGroup::attachRandomBalancer( const UdpSocketRef &socket )
+{
+#if defined( OSC_HAS_REUSEPORT )
+	// returns a random index into the group, which the kernel numbers in the order the sockets bound
+	sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t( SKF_AD_OFF + SKF_AD_RANDOM ) },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, uint32_t( mThreads.size() ) },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	sock_fprog program;
+	program.len = sizeof( code ) / sizeof( code[0] );
+	program.filter = code;
+	if( setsockopt( socket->native_handle(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof( program ) ) )
+		handleError( asio::error_code( errno, asio::error::get_system_category() ), mLocalEndpoint );
+#endif
+}
+
+void ReceiverUdpGroup::setSocketErrorFn( SocketTransportErrorFn<protocol> errorFn )
 {
 	std::lock_guard<std::mutex> lock( mSocketTransportErrorFnMutex );
 	mSocketTransportErrorFn = errorFn;
 }
-	
-void ReceiverUdp::handleError( const asio::error_code &error, const protocol::endpoint &originator )
+
+void ReceiverUdpGroup::handleError( const asio::error_code &error, const protocol::endpoint &originator )
 {
 	std::lock_guard<std::mutex> lock( mSocketTransportErrorFnMutex );
 	if( mSocketTransportErrorFn ) {
@@ -1312,18 +3572,24 @@ void ReceiverUdp::handleError( const asio::error_code &error, const protocol::en
 		CI_LOG_E( error.message() << ", didn't receive message from " << originator.address().to_string() );
 	}
 }
-	
+
 /////////////////////////////////////////////////////////////////////////////////////////
 //// ReceiverTcp
 
 ReceiverTcp::Connection::Connection( TcpSocketRef socket, ReceiverTcp *receiver )
-: mSocket( socket ), mReceiver( receiver ), mDataBuffer( 4096 )
+: mSocket( socket ), mReceiver( receiver ), mId( 0 ), mLastRead( std::chrono::steady_clock::now().time_since_epoch().count() ),
+	mStrand( socket->get_io_service() ), mShutdown( false ), mMaxPacketSize( receiver->mMaxPacketSize ),
+	mBuffer( receiver->mMaxPacketSize ), mRing( std::max<size_t>( receiver->mConnectionBufferSize, 4 ) ), mReadPosition( 0 ), mWritePosition( 0 )
 {
+	if( mReceiver->mPacketFraming )
+		mDecoder = mReceiver->mPacketFraming->createStreamDecoder();
 }
 
 ReceiverTcp::Connection::~Connection()
 {
-	close();
+	// the receiver may already be gone, so errors closing aren't reported
+	asio::error_code ec;
+	mSocket->close( ec );
 	mReceiver = nullptr;
 }
 	
@@ -1336,86 +3602,370 @@ void ReceiverTcp::Connection::close()
 			mReceiver->handleError( ec, getRemoteEndpoint() );
 	}
 }
+
+void ReceiverTcp::Connection::shutdown()
+{
+	// waits out a handler that's running, unless it's the one shutting down from a listener
+	std::unique_lock<std::mutex> lock( mHandlerMutex, std::defer_lock );
+	if( ! mStrand.running_in_this_thread() )
+		lock.lock();
+	mShutdown = true;
+	asio::error_code ec;
+	mSocket->close( ec );
+}
 	
 using iterator = asio::buffers_iterator<asio::streambuf::const_buffers_type>;
-	
-std::pair<iterator, bool> ReceiverTcp::Connection::readMatchCondition( iterator begin, iterator end )
+
+void ReceiverTcp::Connection::read()
 {
-	iterator i = begin;
-	ByteArray<4> data;
-	int inc = 0;
-	while ( i != end && inc < 4 )
-		data[inc++] = *i++;
-	
-	int numBytes = *reinterpret_cast<int*>( data.data() );
-	// swap for big endian from the other side
-	numBytes = ntohl( numBytes );
+	if( mDecoder )
+		readStream();
+	else if( mReceiver->mPacketFraming )
+		readUntil();
+	else
+		readRing();
+}
 	
-	if( inc == 4 && numBytes > 0 && numBytes + 4 <= std::distance( begin, end ) ) {
-		return { begin + numBytes + 4, true };
-	}
-	else {
-		return { begin, false };
-	}
+void ReceiverTcp::Connection::readRing()
+{
+	auto capacity = mRing.size();
+	auto writeIndex = size_t( mWritePosition % capacity );
+	auto free = capacity - size_t( mWritePosition - mReadPosition );
+	// Only up to the wrap point, the rest is read once the write position has wrapped.
+	auto contiguous = std::min( free, capacity - writeIndex );
+	auto self = shared_from_this();
+	mSocket->async_read_some( asio::buffer( mRing.data() + writeIndex, contiguous ), mStrand.wrap(
+	[this, self]( const asio::error_code &error, size_t bytesTransferred ) {
+		std::lock_guard<std::mutex> lock( mHandlerMutex );
+		if( mShutdown )
+			return;
+		if( ! error ) {
+			mWritePosition += bytesTransferred;
+			if( ! dispatchRing() )
+				return;
+		}
+		if( handleReadError( error ) && ! mShutdown )
+			read();
+	}) );
 }
 
-void ReceiverTcp::Connection::read()
-{
-	std::function<std::pair<iterator, bool>( iterator, iterator )> match = &readMatchCondition;
-	if( mReceiver->mPacketFraming )
-		match = std::bind( &PacketFraming::messageComplete, mReceiver->mPacketFraming,
-						  std::placeholders::_1, std::placeholders::_2 );
-	asio::async_read_until( *mSocket, mBuffer, match,
-	[&]( const asio::error_code &error, size_t bytesTransferred ) {
-		if( error ) {
-			auto remote = getRemoteEndpoint();
-			mReceiver->handleError( error, remote );
+bool ReceiverTcp::Connection::dispatchRing()
+{
+	auto capacity = mRing.size();
+	while( mWritePosition - mReadPosition >= 4 ) {
+		auto available = size_t( mWritePosition - mReadPosition );
+		// The size prefix is big endian and may straddle the wrap point itself.
+		uint32_t size = 0;
+		for( uint64_t i = 0; i < 4; i++ )
+			size = ( size << 8 ) | mRing[size_t( ( mReadPosition + i ) % capacity )];
+		
+		if( size > mMaxPacketSize ) {
+			closePacketTooLarge();
+			return false;
+		}
+		if( size > capacity - 4 ) {
+			// Bigger than the ring could ever hold, so whatever part of it is here moves to mScratch and the
+			// rest is read straight into it.
+			auto received = std::min<size_t>( available - 4, size );
+			mScratch.resize( received );
+			copyFromRing( mReadPosition + 4, received, mScratch.data() );
+			mReadPosition = mWritePosition = 0;
+			readOversized( size );
+			return false;
+		}
+		if( available - 4 < size )
+			break;
+		
+		auto begin = size_t( ( mReadPosition + 4 ) % capacity );
+		if( begin + size <= capacity ) {
+			dispatch( mRing.data() + begin, size );
 		}
 		else {
-			ByteBufferRef data = ByteBufferRef( new ByteBuffer( bytesTransferred ) );
-			istream stream( &mBuffer );
-			stream.read( reinterpret_cast<char*>( data->data() ), bytesTransferred );
-			
-			uint8_t *dataPtr = nullptr;
-			size_t dataSize = 0;
-			
-			if( mReceiver->mPacketFraming ) {
-				data = mReceiver->mPacketFraming->decode( data );
-				dataPtr = data->data();
-				dataSize = data->size();
-			}
-			else {
-				dataPtr = data->data() + 4;
-				dataSize = data->size() - 4;
-			}
-			{
-				std::lock_guard<std::mutex> lock( mReceiver->mDispatchMutex );
-				mReceiver->dispatchMethods( dataPtr, dataSize );
+			mScratch.resize( size );
+			copyFromRing( mReadPosition + 4, size, mScratch.data() );
+			dispatch( mScratch.data(), size );
+		}
+		mReadPosition += 4 + size;
+	}
+	// Starting over at the front whenever the ring drains keeps most packets from straddling the wrap point.
+	if( mReadPosition == mWritePosition )
+		mReadPosition = mWritePosition = 0;
+	return true;
+}
+
+void ReceiverTcp::Connection::readOversized( size_t size )
+{
+	// Growing with the bytes that actually arrive keeps a size prefix alone from making mScratch allocate.
+	auto received = mScratch.size();
+	mScratch.resize( received + std::min( size - received, mRing.size() ) );
+	auto self = shared_from_this();
+	asio::async_read( *mSocket, asio::buffer( mScratch.data() + received, mScratch.size() - received ), mStrand.wrap(
+	[this, self, size]( const asio::error_code &error, size_t bytesTransferred ) {
+		std::lock_guard<std::mutex> lock( mHandlerMutex );
+		if( mShutdown )
+			return;
+		if( ! error && mScratch.size() < size ) {
+			handleReadError( error );
+			readOversized( size );
+			return;
+		}
+		if( ! error )
+			dispatch( mScratch.data(), mScratch.size() );
+		if( handleReadError( error ) && ! mShutdown )
+			read();
+	}) );
+}
+
+void ReceiverTcp::Connection::closePacketTooLarge()
+{
+	auto endpoint = getRemoteEndpoint();
+	CI_LOG_W( "Closing connection: " << endpoint << ", packet over the maximum of " << mMaxPacketSize << " bytes" );
+	mReceiver->handleError( asio::error::message_size, endpoint );
+	mReceiver->cleanConnection( this, CloseReason::PACKET_TOO_LARGE );
+	shutdown();
+}
+
+void ReceiverTcp::Connection::copyFromRing( uint64_t position, size_t size, uint8_t *data ) const
+{
+	auto capacity = mRing.size();
+	auto begin = size_t( position % capacity );
+	auto first = std::min( size, capacity - begin );
+	memcpy( data, mRing.data() + begin, first );
+	memcpy( data + first, mRing.data(), size - first );
+}
+
+void ReceiverTcp::Connection::readStream()
+{
+	auto self = shared_from_this();
+	mSocket->async_read_some( asio::buffer( mRing ), mStrand.wrap(
+	[this, self]( const asio::error_code &error, size_t bytesTransferred ) {
+		std::lock_guard<std::mutex> lock( mHandlerMutex );
+		if( mShutdown )
+			return;
+		if( ! error ) {
+			// However the stream was split up, the decoder picks up where the last read left off.
+			const uint8_t *data = mRing.data();
+			while( bytesTransferred > 0 ) {
+				bool packetComplete = false;
+				auto consumed = mDecoder->consume( data, bytesTransferred, &packetComplete );
+				data += consumed;
+				bytesTransferred -= consumed;
+				if( mDecoder->getPacketSize() > mMaxPacketSize ) {
+					closePacketTooLarge();
+					return;
+				}
+				if( packetComplete )
+					dispatch( mDecoder->getPacketData(), mDecoder->getPacketSize() );
 			}
 		}
-		// TODO: Decide if we should handle this.
-		if( error.value() == asio::error::eof ) {
-			CI_LOG_W( "Closing connection: " << getRemoteEndpoint() << ", due to loss of connection" );
-			mReceiver->cleanConnection( this );
+		if( handleReadError( error ) && ! mShutdown )
+			read();
+	}) );
+}
+
+void ReceiverTcp::Connection::readUntil()
+{
+	std::function<std::pair<iterator, bool>( iterator, iterator )> match =
+		std::bind( &PacketFraming::messageComplete, mReceiver->mPacketFraming, std::placeholders::_1, std::placeholders::_2 );
+	auto self = shared_from_this();
+	asio::async_read_until( *mSocket, mBuffer, match, mStrand.wrap(
+	[this, self]( const asio::error_code &error, size_t bytesTransferred ) {
+		std::lock_guard<std::mutex> lock( mHandlerMutex );
+		if( mShutdown )
+			return;
+		// mBuffer filled up to the maximum packet size without the framing finding the end of a packet.
+		if( error == asio::error::not_found ) {
+			closePacketTooLarge();
+			return;
 		}
-		else
+		if( ! error ) {
+			// The streambuf's data is contiguous, so the packet is decoded straight out of it. mScratch keeps its
+			// capacity between reads, so only a larger packet than any before allocates.
+			auto packet = asio::buffer_cast<const uint8_t*>( mBuffer.data() );
+			mReceiver->mPacketFraming->decodeFrame( packet, bytesTransferred, mScratch );
+			mBuffer.consume( bytesTransferred );
+			dispatch( mScratch.data(), mScratch.size() );
+		}
+		if( handleReadError( error ) && ! mShutdown )
 			read();
-	});
+	}) );
+}
+
+void ReceiverTcp::Connection::dispatch( uint8_t *data, size_t size )
+{
+	if( size == 0 || mShutdown )
+		return;
+	// dispatch is thread-safe, only this connection's strand orders its packets
+	mReceiver->dispatchMethods( data, (uint32_t)size );
+}
+
+bool ReceiverTcp::Connection::handleReadError( const asio::error_code &error )
+{
+	if( ! error ) {
+		// even a read that's short of a packet keeps the connection from idling out
+		mLastRead = std::chrono::steady_clock::now().time_since_epoch().count();
+		return true;
+	}
+	// The socket was closed on this side, nothing left to read.
+	if( error == asio::error::operation_aborted )
+		return false;
+	
+	mReceiver->handleError( error, getRemoteEndpoint() );
+	if( error == asio::error::eof || error == asio::error::connection_reset ) {
+		CI_LOG_W( "Closing connection: " << getRemoteEndpoint() << ", due to loss of connection" );
+		mReceiver->cleanConnection( this, error == asio::error::eof ? CloseReason::PEER_CLOSED : CloseReason::RESET );
+		return false;
+	}
+	return true;
 }
 
+struct ReceiverTcp::IdleWheel {
+	static const size_t kNumBuckets = 32;
+	
+	IdleWheel( asio::io_service &service, ReceiverTcp *receiver )
+	: mTimer( service ), mReceiver( receiver ), mBuckets( kNumBuckets ), mCurrent( 0 ), mTimeout( 0 ),
+		mArmed( false ) {}
+	
+	//! Returns how many ticks on to check a connection that would idle out in \a remaining. mMutex must be held.
+	size_t getTicks( std::chrono::steady_clock::duration remaining ) const
+	{
+		auto ticks = size_t( ( remaining + getTick() - std::chrono::steady_clock::duration( 1 ) ) / getTick() );
+		return std::min( std::max<size_t>( ticks, 1 ), kNumBuckets - 1 );
+	}
+	std::chrono::steady_clock::duration getTick() const
+	{
+		return std::max<std::chrono::steady_clock::duration>( mTimeout / kNumBuckets, std::chrono::milliseconds( 1 ) );
+	}
+	//! Buckets \a connection a full timeout ahead. mMutex must be held.
+	void watch( const std::shared_ptr<Connection> &connection )
+	{
+		if( mArmed )
+			mBuckets[( mCurrent + getTicks( mTimeout ) ) % kNumBuckets].push_back( connection );
+	}
+	//! Starts the timer, watching \a connections. mMutex must be held.
+	void arm( const std::vector<std::shared_ptr<Connection>> &connections )
+	{
+		if( mArmed || mTimeout.count() == 0 )
+			return;
+		mArmed = true;
+		for( auto & connection : connections ) {
+			if( connection )
+				watch( connection );
+		}
+		mTimer.expires_from_now( getTick() );
+		wait();
+	}
+	//! Stops the timer and forgets every connection. mMutex must be held.
+	void disarm()
+	{
+		mArmed = false;
+		asio::error_code ec;
+		mTimer.cancel( ec );
+		for( auto & bucket : mBuckets )
+			bucket.clear();
+	}
+	void wait()
+	{
+		auto wheel = mSelf.lock();
+		mTimer.async_wait( [wheel]( const asio::error_code &error ) {
+			if( error != asio::error::operation_aborted )
+				wheel->tick();
+		});
+	}
+	//! Closes the connections in the current bucket that have idled out and buckets the rest again.
+	void tick()
+	{
+		// shut down once mMutex is released, as shutting down waits out a connection's running handler
+		std::vector<std::shared_ptr<Connection>> expired;
+		std::chrono::steady_clock::duration timeout;
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( ! mReceiver || ! mArmed )
+				return;
+			collect( expired );
+			timeout = mTimeout;
+		}
+		for( auto & connection : expired ) {
+			CI_LOG_W( "Closing connection: " << connection->getRemoteEndpoint() << ", idle for " << std::chrono::duration_cast<std::chrono::milliseconds>( timeout ).count() << "ms" );
+			connection->shutdown();
+		}
+	}
+	//! Moves on to the next bucket, returning the connections in the current one that have idled out in
+	//! \a expired, already removed from the receiver. mMutex must be held.
+	void collect( std::vector<std::shared_ptr<Connection>> &expired )
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto bucket = std::move( mBuckets[mCurrent] );
+		mBuckets[mCurrent].clear();
+		for( auto & watched : bucket ) {
+			auto connection = watched.lock();
+			if( ! connection || connection->mShutdown )
+				continue;
+			auto idle = now.time_since_epoch() - std::chrono::steady_clock::duration( connection->mLastRead.load() );
+			if( idle < mTimeout ) {
+				mBuckets[( mCurrent + getTicks( mTimeout - idle ) ) % kNumBuckets].push_back( std::move( watched ) );
+			}
+			else if( mReceiver->cleanConnection( connection.get(), CloseReason::IDLE_TIMEOUT ) ) {
+				expired.push_back( std::move( connection ) );
+			}
+		}
+		mCurrent = ( mCurrent + 1 ) % kNumBuckets;
+		// from the last expiry rather than now, so ticks don't drift behind
+		mTimer.expires_at( mTimer.expires_at() + getTick() );
+		wait();
+	}
+	
+	std::mutex				mMutex;
+	asio::steady_timer		mTimer;
+	//! Cleared when the receiver is destroyed, after which a tick does nothing.
+	ReceiverTcp*			mReceiver;
+	std::weak_ptr<IdleWheel>	mSelf;
+	//! Connections due to be checked on each tick. A read only notes the time, the connection is
+	//! moved on to the bucket of its new deadline once its current one comes round.
+	std::vector<std::vector<std::weak_ptr<Connection>>>	mBuckets;
+	size_t					mCurrent;
+	std::chrono::steady_clock::duration	mTimeout;
+	bool					mArmed;
+};
+
+const size_t ReceiverTcp::IdleWheel::kNumBuckets;
+
 ReceiverTcp::ReceiverTcp( uint16_t port, PacketFramingRef packetFraming, const protocol &protocol, asio::io_service &service )
-: ReceiverBase( packetFraming ), mAcceptor( new tcp::acceptor( service ) ), mLocalEndpoint( protocol, port )
+: ReceiverBase( packetFraming ), mAcceptor( new tcp::acceptor( service ) ), mLocalEndpoint( protocol, port ),
+	mConnectionBufferSize( 65536 ), mMaxPacketSize( 1 << 24 ), mNumConnections( 0 ), mMaxConnections( 0 )
 {
+	resetConnectionStats();
+	mIdleWheel = std::make_shared<IdleWheel>( service, this );
+	mIdleWheel->mSelf = mIdleWheel;
 }
 
 ReceiverTcp::ReceiverTcp( const protocol::endpoint &localEndpoint, PacketFramingRef packetFraming, asio::io_service &service )
-: ReceiverBase( packetFraming ), mAcceptor( new tcp::acceptor( service ) ), mLocalEndpoint( localEndpoint )
+: ReceiverBase( packetFraming ), mAcceptor( new tcp::acceptor( service ) ), mLocalEndpoint( localEndpoint ),
+	mConnectionBufferSize( 65536 ), mMaxPacketSize( 1 << 24 ), mNumConnections( 0 ), mMaxConnections( 0 )
 {
+	resetConnectionStats();
+	mIdleWheel = std::make_shared<IdleWheel>( service, this );
+	mIdleWheel->mSelf = mIdleWheel;
 }
 	
 ReceiverTcp::ReceiverTcp( AcceptorRef acceptor, PacketFramingRef packetFraming )
-: ReceiverBase( packetFraming ), mAcceptor( acceptor ), mLocalEndpoint( mAcceptor->local_endpoint() )
+: ReceiverBase( packetFraming ), mAcceptor( acceptor ), mLocalEndpoint( mAcceptor->local_endpoint() ),
+	mConnectionBufferSize( 65536 ), mMaxPacketSize( 1 << 24 ), mNumConnections( 0 ), mMaxConnections( 0 )
+{
+	resetConnectionStats();
+	mIdleWheel = std::make_shared<IdleWheel>( mAcceptor->get_io_service(), this );
+	mIdleWheel->mSelf = mIdleWheel;
+}
+
+ReceiverTcp::~ReceiverTcp()
 {
+	{
+		std::lock_guard<std::mutex> lock( mIdleWheel->mMutex );
+		mIdleWheel->mReceiver = nullptr;
+		mIdleWheel->disarm();
+	}
+	// connections with a read pending outlive the receiver, they mustn't dispatch to it
+	closeConnections();
 }
 	
 void ReceiverTcp::bindImpl()
@@ -1454,6 +4004,10 @@ void ReceiverTcp::listenImpl()
 		return;
 	}
 	accept();
+	
+	std::lock_guard<std::mutex> wheelLock( mIdleWheel->mMutex );
+	std::lock_guard<std::mutex> lock( mConnectionMutex );
+	mIdleWheel->arm( mConnections );
 }
 	
 void ReceiverTcp::accept()
@@ -1462,16 +4016,49 @@ void ReceiverTcp::accept()
 
 	mAcceptor->async_accept( *socket, std::bind(
 	[&]( TcpSocketRef socket, const asio::error_code &error ) {
+		if( error == asio::error::operation_aborted )
+			return;
 		if( ! error ) {
-			{
-				std::lock_guard<std::mutex> lock( mOnAcceptFnMutex );
-				if( mOnAcceptFn )
-					mOnAcceptFn( socket );
-			}
+			bool rejected;
 			{
 				std::lock_guard<std::mutex> lock( mConnectionMutex );
-				mConnections.emplace_back( new Connection( socket, this ) );
-				mConnections.back()->read();
+				mAccepted++;
+				auto second = std::chrono::duration_cast<std::chrono::seconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+				auto &recent = mRecentAccepts[size_t( second ) % kAcceptWindow];
+				if( recent.first != second )
+					recent = { second, 0 };
+				recent.second++;
+				rejected = mMaxConnections && mNumConnections >= mMaxConnections;
+				if( rejected )
+					mClosed[size_t( CloseReason::CONNECTION_LIMIT )]++;
+			}
+			if( rejected ) {
+				asio::error_code ec;
+				socket->close( ec );
+			}
+			else {
+				{
+					std::lock_guard<std::mutex> lock( mOnAcceptFnMutex );
+					if( mOnAcceptFn )
+						mOnAcceptFn( socket );
+				}
+				auto connection = std::make_shared<Connection>( socket, this );
+				{
+					std::lock_guard<std::mutex> lock( mConnectionMutex );
+					if( mFreeSlots.empty() ) {
+						connection->mId = uint32_t( mConnections.size() );
+						mConnections.push_back( connection );
+					}
+					else {
+						connection->mId = mFreeSlots.back();
+						mFreeSlots.pop_back();
+						mConnections[connection->mId] = connection;
+					}
+					mNumConnections++;
+					connection->read();
+				}
+				std::lock_guard<std::mutex> lock( mIdleWheel->mMutex );
+				mIdleWheel->watch( connection );
 			}
 		}
 		else {
@@ -1493,21 +4080,103 @@ void ReceiverTcp::closeAcceptor()
 void ReceiverTcp::closeImpl()
 {
 	closeAcceptor();
+	{
+		std::lock_guard<std::mutex> lock( mIdleWheel->mMutex );
+		mIdleWheel->disarm();
+	}
+	closeConnections();
+}
+
+void ReceiverTcp::closeConnections()
+{
+	std::vector<SharedConnection> connections;
+	{
+		std::lock_guard<std::mutex> lock( mConnectionMutex );
+		for( auto & connection : mConnections ) {
+			if( connection )
+				connections.push_back( std::move( connection ) );
+		}
+		mClosed[size_t( CloseReason::CLOSED )] += connections.size();
+		mConnections.clear();
+		mFreeSlots.clear();
+		mNumConnections = 0;
+	}
+	// a running handler may be waiting on mConnectionMutex, so it's released before waiting on the handler
+	for( auto & connection : connections )
+		connection->shutdown();
+}
 	
+bool ReceiverTcp::cleanConnection( Connection *connection, CloseReason reason )
+{
+	std::lock_guard<std::mutex> lock( mConnectionMutex );
+	auto id = connection->mId;
+	if( id >= mConnections.size() || mConnections[id].get() != connection )
+		return false;
+	mConnections[id].reset();
+	mFreeSlots.push_back( id );
+	mNumConnections--;
+	mClosed[size_t( reason )]++;
+	return true;
+}
+
+void ReceiverTcp::setMaxConnections( size_t maxConnections )
+{
+	std::lock_guard<std::mutex> lock( mConnectionMutex );
+	mMaxConnections = maxConnections;
+}
+
+size_t ReceiverTcp::getMaxConnections() const
+{
 	std::lock_guard<std::mutex> lock( mConnectionMutex );
-	for( auto & connection : mConnections ) {
-		connection->close();
+	return mMaxConnections;
+}
+
+void ReceiverTcp::setIdleTimeout( std::chrono::milliseconds timeout )
+{
+	std::lock_guard<std::mutex> wheelLock( mIdleWheel->mMutex );
+	mIdleWheel->disarm();
+	mIdleWheel->mTimeout = timeout;
+	// otherwise the wheel starts turning once the receiver listens
+	if( mAcceptor->is_open() ) {
+		std::lock_guard<std::mutex> lock( mConnectionMutex );
+		mIdleWheel->arm( mConnections );
 	}
-	mConnections.clear();
 }
-	
-void ReceiverTcp::cleanConnection( Connection *connection )
+
+std::chrono::milliseconds ReceiverTcp::getIdleTimeout() const
+{
+	std::lock_guard<std::mutex> lock( mIdleWheel->mMutex );
+	return std::chrono::duration_cast<std::chrono::milliseconds>( mIdleWheel->mTimeout );
+}
+
+ReceiverTcp::ConnectionStats ReceiverTcp::getConnectionStats() const
+{
+	std::lock_guard<std::mutex> lock( mConnectionMutex );
+	ConnectionStats stats;
+	stats.accepted = mAccepted;
+	// the window ends partway through the current second
+	auto now = std::chrono::steady_clock::now();
+	auto second = std::chrono::duration_cast<std::chrono::seconds>( now.time_since_epoch() ).count();
+	uint64_t recentAccepts = 0;
+	for( auto & recent : mRecentAccepts ) {
+		if( recent.first > second - int64_t( kAcceptWindow ) )
+			recentAccepts += recent.second;
+	}
+	auto window = std::chrono::duration<double>( now.time_since_epoch() - std::chrono::seconds( second ) ).count() + kAcceptWindow - 1;
+	auto seconds = std::min( window, std::chrono::duration<double>( now - mStatsStart ).count() );
+	stats.acceptsPerSecond = seconds > 0 ? recentAccepts / seconds : 0;
+	stats.active = mNumConnections;
+	stats.closed = mClosed;
+	return stats;
+}
+
+void ReceiverTcp::resetConnectionStats()
 {
 	std::lock_guard<std::mutex> lock( mConnectionMutex );
-	mConnections.erase( remove_if( mConnections.begin(), mConnections.end(),
-	[connection]( const UniqueConnection &cached) {
-		  return cached.get() == connection;
-	}));
+	mAccepted = 0;
+	mClosed.fill( 0 );
+	mRecentAccepts.fill( { 0, 0 } );
+	mStatsStart = std::chrono::steady_clock::now();
 }
 	
 void ReceiverTcp::handleError( const asio::error_code &error, const protocol::endpoint &originator )
@@ -1521,23 +4190,37 @@ void ReceiverTcp::handleError( const asio::error_code &error, const protocol::en
 	}
 }
 
+void PacketFraming::encodeFrame( const uint8_t *data, size_t size, ByteBuffer &encoded )
+{
+	// buffers in this system begin with the size, which encode( ByteBufferRef ) expects.
+	ByteBufferRef buffer( new ByteBuffer( size + 4 ) );
+	uint32_t packetSize = htonl( (uint32_t)size );
+	memcpy( buffer->data(), &packetSize, 4 );
+	memcpy( buffer->data() + 4, data, size );
+	auto encodedBuffer = encode( buffer );
+	encoded.assign( encodedBuffer->begin(), encodedBuffer->end() );
+}
+
+void PacketFraming::decodeFrame( const uint8_t *data, size_t size, ByteBuffer &decoded )
+{
+	auto decodedBuffer = decode( ByteBufferRef( new ByteBuffer( data, data + size ) ) );
+	decoded.assign( decodedBuffer->begin(), decodedBuffer->end() );
+}
+
 ByteBufferRef SLIPPacketFraming::encode( ByteBufferRef bufferToEncode )
 {
 	// buffers in this system begin with the size, which will be removed in the case of Packet Framing.
-	auto maxEncodedSize = 2 * (bufferToEncode->size() - 4) + 2;
-	auto encodeBuffer = ByteBufferRef( new ByteBuffer( maxEncodedSize ) );
-	auto finalEncodedSize = encode( bufferToEncode->data() + 4, bufferToEncode->size() - 4, encodeBuffer->data() );
-	encodeBuffer->resize( finalEncodedSize );
+	auto data = bufferToEncode->data() + 4;
+	auto size = bufferToEncode->size() - 4;
+	auto encodeBuffer = ByteBufferRef( new ByteBuffer( getEncodedSize( data, size ) ) );
+	encode( data, size, encodeBuffer->data() );
 	return encodeBuffer;
 }
 
 ByteBufferRef SLIPPacketFraming::decode( ByteBufferRef bufferToDecode )
 {
-	// should not assume double-ENDed variant
-	auto maxDecodedSize = bufferToDecode->size() - 1;
-	auto decodeBuffer = ByteBufferRef( new ByteBuffer( maxDecodedSize ) );
-	auto finalDecodedSize = decode( bufferToDecode->data(), bufferToDecode->size(), decodeBuffer->data() );
-	decodeBuffer->resize( finalDecodedSize );
+	auto decodeBuffer = ByteBufferRef( new ByteBuffer );
+	decode( bufferToDecode->data(), bufferToDecode->size(), *decodeBuffer );
 	return decodeBuffer;
 }
 	
@@ -1555,55 +4238,166 @@ std::pair<iterator, bool> SLIPPacketFraming::messageComplete( iterator begin, it
 	return { begin, false };
 }
 
+std::unique_ptr<PacketFraming::StreamDecoder> SLIPPacketFraming::createStreamDecoder()
+{
+	return std::unique_ptr<StreamDecoder>( new SLIPStreamDecoder );
+}
+
+size_t SLIPPacketFraming::SLIPStreamDecoder::consume( const uint8_t *data, size_t size, bool *packetComplete )
+{
+	*packetComplete = false;
+	if( mComplete ) {
+		mPacket.clear();
+		mComplete = false;
+	}
+	
+	auto begin = data;
+	auto end = data + size;
+	while( data != end ) {
+		if( mEscaped ) {
+			if( *data == SLIP_ESC_END ) {
+				mPacket.push_back( uint8_t( SLIP_END ) );
+			} else if( *data == SLIP_ESC_ESC ) {
+				mPacket.push_back( uint8_t( SLIP_ESC ) );
+			} else {
+				// protocol violation
+			}
+			mEscaped = false;
+			data++;
+			continue;
+		}
+		auto special = findSpecial( data, end );
+		mPacket.insert( mPacket.end(), data, special );
+		if( special == end )
+			return size;
+		data = special + 1;
+		if( *special == SLIP_ESC ) {
+			mEscaped = true;
+		}
+		// A SLIP_END on an empty packet is the leading one of the double-ENDed variant.
+		else if( ! mPacket.empty() ) {
+			mComplete = true;
+			*packetComplete = true;
+			break;
+		}
+	}
+	return data - begin;
+}
+
+const uint8_t* SLIPPacketFraming::findSpecial( const uint8_t *begin, const uint8_t *end )
+{
+#if defined( OSC_HAS_SSE2 )
+	const __m128i endBytes = _mm_set1_epi8( (char)SLIP_END );
+	const __m128i escBytes = _mm_set1_epi8( (char)SLIP_ESC );
+	for( ; end - begin >= 16; begin += 16 ) {
+		__m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( begin ) );
+		int mask = _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( chunk, endBytes ), _mm_cmpeq_epi8( chunk, escBytes ) ) );
+		if( mask ) {
+#if defined( _MSC_VER )
+			unsigned long index;
+			_BitScanForward( &index, mask );
+			return begin + index;
+#else
+			return begin + __builtin_ctz( mask );
+#endif
+		}
+	}
+#elif defined( OSC_HAS_NEON )
+	const uint8x16_t endBytes = vdupq_n_u8( SLIP_END );
+	const uint8x16_t escBytes = vdupq_n_u8( SLIP_ESC );
+	for( ; end - begin >= 16; begin += 16 ) {
+		uint8x16_t chunk = vld1q_u8( begin );
+		// The byte scan below pinpoints it within the chunk.
+		if( vmaxvq_u8( vorrq_u8( vceqq_u8( chunk, endBytes ), vceqq_u8( chunk, escBytes ) ) ) )
+			break;
+	}
+#endif
+	for( ; begin != end; ++begin ) {
+		if( *begin == SLIP_END || *begin == SLIP_ESC )
+			return begin;
+	}
+	return end;
+}
+
+size_t SLIPPacketFraming::getEncodedSize( const uint8_t *data, size_t size )
+{
+	auto end = data + size;
+	// Both SLIP_ENDs, plus one more byte for every escaped one.
+	size_t encodedSize = size + 2;
+	while( ( data = findSpecial( data, end ) ) != end ) {
+		encodedSize++;
+		data++;
+	}
+	return encodedSize;
+}
+
 size_t SLIPPacketFraming::encode( const uint8_t* data, size_t size, uint8_t* encodedData )
 {
-	size_t readIDX = 0, writeIDX = 0;
+	auto end = data + size;
+	auto out = encodedData;
 	
 	// double-ENDed variant, will flush any accumulated line noise
-	encodedData[writeIDX++] = SLIP_END;
+	*out++ = SLIP_END;
 	
-	while (readIDX < size) {
-		uint8_t value = data[readIDX++];
-		
-		if (value == SLIP_END) {
-			encodedData[writeIDX++] = SLIP_ESC;
-			encodedData[writeIDX++] = SLIP_ESC_END;
-		} else if (value == SLIP_ESC) {
-			encodedData[writeIDX++] = SLIP_ESC;
-			encodedData[writeIDX++] = SLIP_ESC_ESC;
-		} else {
-			encodedData[writeIDX++] = value;
-		}
+	while( data != end ) {
+		auto special = findSpecial( data, end );
+		memcpy( out, data, special - data );
+		out += special - data;
+		if( special == end )
+			break;
+		*out++ = SLIP_ESC;
+		*out++ = *special == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+		data = special + 1;
 	}
-	encodedData[writeIDX++] = SLIP_END;
+	*out++ = SLIP_END;
 	
-	return writeIDX;
+	return out - encodedData;
 }
 
-size_t SLIPPacketFraming::decode(const uint8_t* data, size_t size, uint8_t* decodedData)
+size_t SLIPPacketFraming::decode( const uint8_t* data, size_t size, uint8_t* decodedData )
 {
-	size_t readIDX = 0, writeIDX = 0;
+	auto end = data + size;
+	auto out = decodedData;
 	
-	while (readIDX < size) {
-		uint8_t value = data[readIDX++];
-		
-		if (value == SLIP_END) {
+	while( data != end ) {
+		auto special = findSpecial( data, end );
+		// Decoding in place means the run may overlap where it's written.
+		memmove( out, data, special - data );
+		out += special - data;
+		if( special == end )
+			break;
+		data = special + 1;
+		if( *special == SLIP_END ) {
 			// flush or done
-		} else if (value == SLIP_ESC) {
-			value = data[readIDX++];
-			if (value == SLIP_ESC_END) {
-				decodedData[writeIDX++] = SLIP_END;
-			} else if (value == SLIP_ESC_ESC) {
-				decodedData[writeIDX++] = SLIP_ESC;
-			} else {
-				// protocol violation
-			}
+			continue;
+		}
+		if( data == end ) {
+			// protocol violation, escape at the very end
+			break;
+		}
+		if( *data == SLIP_ESC_END ) {
+			*out++ = SLIP_END;
+		} else if( *data == SLIP_ESC_ESC ) {
+			*out++ = SLIP_ESC;
 		} else {
-			decodedData[writeIDX++] = value;
+			// protocol violation
 		}
+		data++;
 	}
 	
-	return writeIDX;
+	return out - decodedData;
+}
+
+void SLIPPacketFraming::encode( const uint8_t *data, size_t size, ByteBuffer &encoded )
+{
+	encoded.resize( getMaxEncodedSize( size ) );
+	encoded.resize( encode( data, size, encoded.data() ) );
+}
+
+void SLIPPacketFraming::decode( const uint8_t *data, size_t size, ByteBuffer &decoded )
+{
+	decoded.resize( size );
+	decoded.resize( decode( data, size, decoded.data() ) );
 }
 
 namespace time {
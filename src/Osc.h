@@ -35,6 +35,13 @@
 #include "asio/asio.hpp"
 
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <bitset>
 
 #include "cinder/Buffer.h"
 #include "cinder/app/App.h"
@@ -49,6 +56,8 @@ namespace osc {
 	
 //! Argument types suported by the Message class
 enum class ArgType : char { INTEGER_32 = 'i', FLOAT = 'f', DOUBLE = 'd', STRING = 's', BLOB = 'b', MIDI = 'm', TIME_TAG = 't', INTEGER_64 = 'h', BOOL_T = 'T', BOOL_F = 'F', CHAR = 'c', NULL_T = 'N', IMPULSE = 'I', NONE = NULL_T };
+//! Reasons a received packet fails to decode, NUM_ERRORS is their count.
+enum class ParseError { MISSING_ADDRESS, MISSING_TYPE_TAGS, INCOMPLETE_TYPE_TAGS, BLOB_TOO_LONG, BUNDLE_TOO_SHORT, BUNDLE_SEGMENT_TOO_LONG, TRUNCATED, NUM_ERRORS };
 	
 // Forward declarations
 using UdpSocketRef = std::shared_ptr<asio::ip::udp::socket>;
@@ -174,6 +183,11 @@ public:
 	void setAddress( const std::string& address );
 	//! Returns the OSC address of this message.
 	const std::string& getAddress() const { return mAddress; }
+	//! Returns when the datagram carrying this message reached the receiving socket, as time since the
+	//! Unix epoch, or zero if it wasn't stamped. See ReceiverUdp::setReceiveTimestamps.
+	std::chrono::nanoseconds getReceiveTime() const { return mReceiveTime; }
+	//! Returns the time tag of the bundle this message was received in, 0 if it wasn't in one.
+	uint64_t getBundleTimetag() const { return mBundleTimetag; }
 	
 	//! Returns the size of this OSC message as a complete packet.
 	//! Performs a lazy cache
@@ -322,13 +336,16 @@ private:
 	std::string				mAddress;
 	ByteBuffer				mDataBuffer;
 	std::vector<Argument>	mDataViews;
-	mutable bool			mIsCached;
+	mutable bool			mIsCached = false;
 	mutable ByteBufferRef	mCache;
+	//! Set by the receiver.
+	std::chrono::nanoseconds	mReceiveTime = std::chrono::nanoseconds::zero();
+	uint64_t					mBundleTimetag = 0;
 	
 	//! Create the OSC message and store it in cache.
 	void createCache() const;
-	//! Used by receiver to create the inner message.
-	bool bufferCache( uint8_t *data, size_t size );
+	//! Used by receiver to create the inner message. Sets \a error to the reason on failure.
+	bool bufferCache( uint8_t *data, size_t size, ParseError &error );
 	
 	friend class Bundle;
 	friend class SenderBase;
@@ -415,17 +432,42 @@ using PacketFramingRef = std::shared_ptr<class PacketFraming>;
 	
 class PacketFraming {
 public:
+	//! Per-connection state for un-framing a stream as it arrives, so that each byte is looked at once no matter
+	//! how the stream is split up. Created by createStreamDecoder().
+	class StreamDecoder {
+	public:
+		virtual ~StreamDecoder() = default;
+		//! Un-frames up to \a size bytes at \a data, returning the number of bytes consumed. Stops right after the
+		//! end of a packet, in which case \a packetComplete is set and the packet is available from getPacketData()
+		//! and getPacketSize() until the next call.
+		virtual size_t consume( const uint8_t *data, size_t size, bool *packetComplete ) = 0;
+		//! Returns the packet completed by the last call to consume().
+		virtual uint8_t* getPacketData() = 0;
+		//! Returns the size of the packet completed by the last call to consume(), or while it's incomplete, how
+		//! much of it has been un-framed so far.
+		virtual size_t getPacketSize() const = 0;
+	};
+	
 	virtual ~PacketFraming() = default;
 	//! Abstract signature to implement the encode process.
 	virtual ByteBufferRef encode( ByteBufferRef bufferToEncode ) = 0;
 	//! Abstract signature to implement the decode process.
 	virtual ByteBufferRef decode( ByteBufferRef bufferToDecode ) = 0;
+	//! Encodes \a size bytes of \a data into \a encoded, reusing its capacity. The transports frame through this,
+	//! so overriding it makes framing allocation free. The default adapts encode( ByteBufferRef ).
+	virtual void encodeFrame( const uint8_t *data, size_t size, ByteBuffer &encoded );
+	//! Decodes \a size bytes of \a data into \a decoded, reusing its capacity. The default adapts
+	//! decode( ByteBufferRef ).
+	virtual void decodeFrame( const uint8_t *data, size_t size, ByteBuffer &decoded );
 	//! Alias representing the iterator type passed the message complete function.
 	using iterator = asio::buffers_iterator<asio::streambuf::const_buffers_type>;
 	//! Abstract signature used to implement the read_until message match_condition. For more info on
 	//! the use of this function read about match_condition here...
 	//! http://think-async.com/Asio/asio-1.10.6/doc/asio/reference/async_read_until/overload4.html
 	virtual std::pair<iterator, bool> messageComplete( iterator begin, iterator end ) = 0;
+	//! Returns a new StreamDecoder for a connection, or nullptr if the framing is only detected through
+	//! messageComplete, which is the default.
+	virtual std::unique_ptr<StreamDecoder> createStreamDecoder() { return nullptr; }
 
 protected:
 	PacketFraming() = default;
@@ -441,41 +483,235 @@ public:
 	//! asio's error_codes, look at "asio/error.hpp".
 	using SocketTransportErrorFn = std::function<void( const asio::error_code & /*error*/,
 													   const std::string & /*oscAddress*/)>;
+	//! Alias function called once a send has completed, failed, or was rejected or dropped before reaching
+	//! the socket. Rejected and dropped sends report asio::error::no_buffer_space.
+	using SendCompletionFn = std::function<void( const asio::error_code & /*error*/ )>;
+	//! Alias function called when a send is made while the in-flight sends or bytes are at the high-water mark.
+	using BackpressureFn = std::function<void( size_t /*inFlightSends*/, size_t /*inFlightBytes*/ )>;
+	
+	//! Describes what happens to sends made while the in-flight sends or bytes are at the high-water mark.
+	enum class BackpressurePolicy {
+		//! The send is rejected and never reaches the socket.
+		REJECT,
+		//! The send goes ahead and the BackpressureFn is called.
+		NOTIFY
+	};
+	
+	//! Describes what happens to packets that exceed the pacing budget.
+	enum class PacingPolicy {
+		//! Holds packets back until the budget allows them, dropping the newest once the queue is full.
+		QUEUE,
+		//! Holds packets back until the budget allows them, dropping the oldest once the queue is full.
+		QUEUE_DROP_OLDEST,
+		//! Drops packets that exceed the budget right away.
+		DROP
+	};
+	//! Token bucket configuration for pacing outgoing packets. A rate of 0 leaves that dimension unlimited.
+	struct PacingOptions {
+		PacingOptions()
+		: messagesPerSecond( 0 ), bytesPerSecond( 0 ), burstMessages( 1 ), burstBytes( 0 ),
+			maxQueueSize( 1024 ), policy( PacingPolicy::QUEUE ) {}
+		
+		//! Sustained message rate.
+		double			messagesPerSecond;
+		//! Sustained byte rate, counted over the transported buffer.
+		double			bytesPerSecond;
+		//! Number of messages that may go out back to back after an idle period.
+		uint32_t		burstMessages;
+		//! Number of bytes that may go out back to back after an idle period. 0 allows one second's worth.
+		uint32_t		burstBytes;
+		//! Maximum number of packets held back by the QUEUE policies.
+		size_t			maxQueueSize;
+		PacingPolicy	policy;
+	};
+	//! Snapshot of the pacing state.
+	struct PacingStats {
+		//! Number of packets currently held back.
+		size_t						queueDepth;
+		//! Packets handed to the transport, whether immediately or after a delay.
+		uint64_t					sent;
+		//! Packets that had to wait for the budget.
+		uint64_t					delayed;
+		//! Packets discarded because of the budget or a full queue.
+		uint64_t					dropped;
+		//! Time the most recently released packet waited in the queue.
+		std::chrono::microseconds	lastDelay;
+		//! Longest time any packet waited in the queue.
+		std::chrono::microseconds	maxDelay;
+		//! Average time delayed packets waited in the queue.
+		std::chrono::microseconds	averageDelay;
+	};
 	
 	//! Binds the underlying network socket. Should be called before trying any communication operations.
 	void bind() { bindImpl(); }
-	//! Sends \a message to the destination endpoint.
-	void send( const Message &message ) { sendImpl( message.getSharedBuffer() ); }
-	//! Sends \a bundle to the destination endpoint.
-	void send( const Bundle &bundle ) { sendImpl( bundle.getSharedBuffer() ); }
+	//! Sends \a message to the destination endpoint. Returns false if the send was rejected by the high-water
+	//! mark or dropped by pacing.
+	bool send( const Message &message ) { return send( message, nullptr ); }
+	//! Sends \a message to the destination endpoint and calls \a onComplete once it's done. Returns false if
+	//! the send was rejected by the high-water mark or dropped by pacing, \a onComplete is still called.
+	bool send( const Message &message, SendCompletionFn onComplete );
+	//! Sends \a bundle to the destination endpoint. Returns false if the send was rejected by the high-water
+	//! mark or dropped by pacing.
+	bool send( const Bundle &bundle ) { return transmit( bundle.getSharedBuffer(), nullptr ); }
+	//! Sends \a bundle to the destination endpoint and calls \a onComplete once it's done. Returns false if
+	//! the send was rejected by the high-water mark or dropped by pacing, \a onComplete is still called.
+	bool send( const Bundle &bundle, SendCompletionFn onComplete ) { return transmit( bundle.getSharedBuffer(), std::move( onComplete ) ); }
 	//! Closes the underlying connection to the socket.
 	void close() { closeImpl(); }
 	
 	//! Sets the underlying socket transport error fn with \a errorFn.
 	void setSocketTransportErrorFn( SocketTransportErrorFn errorFn );
 	
+	//! Paces outgoing packets with token buckets described by \a options. Packets held back are released
+	//! from a timer on the socket's io_service.
+	void setPacing( const PacingOptions &options );
+	//! Stops pacing. Packets still held back are sent right away.
+	void disablePacing();
+	//! Returns whether outgoing packets are paced.
+	bool isPacingEnabled() const { return mPacingEnabled; }
+	//! Returns the current pacing queue depth, counters and delays.
+	PacingStats getPacingStats() const;
+	
+	//! Limits the sends handed to the socket but not yet completed to \a maxSends and \a maxBytes. A limit of 0
+	//! is unbounded. \a policy decides whether sends beyond the limit are rejected or trigger the BackpressureFn.
+	void setHighWaterMark( size_t maxSends, size_t maxBytes, BackpressurePolicy policy = BackpressurePolicy::REJECT );
+	//! Sets the function called for sends made at the high-water mark under BackpressurePolicy::NOTIFY.
+	void setBackpressureFn( BackpressureFn backpressureFn );
+	//! Returns the number of sends handed to the socket and not yet completed.
+	size_t getInFlightSends() const { return mInFlightSends; }
+	//! Returns the number of bytes handed to the socket and not yet completed.
+	size_t getInFlightBytes() const { return mInFlightBytes; }
+	
+	//! Enables change suppression. Messages whose encoded arguments are identical to the last ones sent to
+	//! the same address are skipped, except once \a refreshInterval has passed since that address last went
+	//! out, so late joining receivers still converge. A \a refreshInterval of 0 never refreshes. There's no
+	//! timer, a value is only refreshed when it's sent again after the interval. A send that's rejected,
+	//! dropped or fails doesn't count as the last value, so the next identical one still goes out. Skipped
+	//! sends report success to their SendCompletionFn. Bundles are never suppressed.
+	void setChangeSuppression( bool enable, std::chrono::milliseconds refreshInterval = std::chrono::milliseconds( 1000 ) );
+	//! Returns whether change suppression is enabled.
+	bool isChangeSuppressionEnabled() const { return mChangeSuppressionEnabled; }
+	//! Forgets the last values of all addresses, so the next message to each goes out.
+	void resetChangeSuppression();
+	//! Returns the number of messages skipped by change suppression.
+	uint64_t getSuppressedCount() const { return mSuppressedCount; }
+	
 protected:
 	SenderBase( PacketFramingRef packetFraming )
-	: mPacketFraming( packetFraming ) {}
+	: mPacketFraming( packetFraming ), mInFlightSends( 0 ), mInFlightBytes( 0 ), mMaxInFlightSends( 0 ),
+		mMaxInFlightBytes( 0 ), mBackpressurePolicy( BackpressurePolicy::REJECT ), mPacingEnabled( false ),
+		mPacingTimerArmed( false ), mDispatchingReady( false ), mMessageTokens( 0 ), mByteTokens( 0 ), mPacingStats(), mTotalPacingDelayUs( 0 ),
+		mChangeSuppressionEnabled( false ), mRefreshInterval( 1000 ), mSuppressedCount( 0 ) {}
 	
-	virtual ~SenderBase() = default;
+	virtual ~SenderBase();
 	SenderBase( const SenderBase &other ) = delete;
 	SenderBase& operator=( const SenderBase &other ) = delete;
 	SenderBase( SenderBase &&other ) = delete;
 	SenderBase& operator=( SenderBase &&other ) = delete;
 	
-	//! Abstract send function implemented by the network layer.
-	virtual void sendImpl( const ByteBufferRef &byteBuffer ) = 0;
+	//! Abstract send function implemented by the network layer. Must call \a onComplete exactly once, when the
+	//! send has completed or failed.
+	virtual void sendImpl( const ByteBufferRef &byteBuffer, SendCompletionFn onComplete ) = 0;
 	//! Abstract close function implemented by the network layer
 	virtual void closeImpl() = 0;
 	//! Abstract bind function implemented by the network layer
 	virtual void bindImpl() = 0;
+	//! Abstract accessor for the io_service driving the network layer, used for timers.
+	virtual asio::io_service& getIoService() = 0;
+	//! Stops the pacing timer from calling back into this sender, waiting for a tick that's running to finish.
+	//! Called by the network layer's destructor, before the socket a tick would send on is gone.
+	void detachPacingTimer();
 	//! Handles error
 	virtual void handleError( const asio::error_code &error, const std::string &oscAddress);
 	
+	//! Hands \a data to the network layer, subject to the high-water mark and pacing. Returns false if it was
+	//! rejected or dropped.
+	bool transmit( const ByteBufferRef &data, SendCompletionFn onComplete );
+	//! Returns true if change suppression skips \a data, encoded from \a message, in which case it's counted
+	//! and \a onComplete is called with success. Otherwise wraps \a onComplete to forget \a data as the
+	//! address's last value again if the send doesn't go out.
+	bool suppressUnchanged( const Message &message, const ByteBufferRef &data, SendCompletionFn &onComplete );
+	//! Returns whether \a numSends more sends of \a size bytes in total stay within the high-water mark.
+	bool isWithinHighWaterMark( size_t numSends, size_t size ) const;
+	//! Counts \a numSends sends of \a size bytes in total as in flight until the returned function is called
+	//! with their result, which it passes on to \a onComplete once per send.
+	SendCompletionFn trackInFlight( size_t numSends, size_t size, SendCompletionFn onComplete );
+	
 	SocketTransportErrorFn	mSocketTransportErrorFn;
 	std::mutex				mSocketErrorFnMutex;
 	PacketFramingRef		mPacketFraming;
+	
+private:
+	using PacingClock = std::chrono::steady_clock;
+	struct PacedPacket {
+		ByteBufferRef			data;
+		SendCompletionFn		onComplete;
+		PacingClock::time_point	queued;
+	};
+	
+	//! Counts \a data as in flight and hands it to sendImpl.
+	void dispatchSend( const ByteBufferRef &data, const SendCompletionFn &onComplete );
+	std::atomic<size_t>					mInFlightSends, mInFlightBytes;
+	std::atomic<size_t>					mMaxInFlightSends, mMaxInFlightBytes;
+	std::atomic<BackpressurePolicy>		mBackpressurePolicy;
+	BackpressureFn						mBackpressureFn;
+	std::mutex							mBackpressureFnMutex;
+	
+	//! Adds the tokens accumulated since the last refill, up to the burst allowance.
+	void refillPacingTokens( PacingClock::time_point now );
+	//! Returns true and takes the tokens for a packet of \a size bytes if the budget allows it.
+	bool takePacingTokens( size_t size );
+	//! Moves as many queued packets as the budget allows to mReadyPackets and rearms the timer for the rest.
+	//! Expects mPacingMutex to be held.
+	void releasePacedPackets();
+	//! Sends mReadyPackets, in order, with \a lock on mPacingMutex released, so a completion that runs
+	//! on this thread can send again. A send made meanwhile, from another thread or a completion, is left
+	//! to the thread already sending, which keeps packets in order. Returns with \a lock held.
+	void dispatchReadyPackets( std::unique_lock<std::mutex> &lock );
+	
+	//! The timer releasing held back packets, shared with its handler so a tick that has already fired can
+	//! tell whether its sender is still there.
+	struct PacingTimer {
+		PacingTimer( asio::io_service &service, SenderBase *sender ) : mTimer( service ), mSender( sender ) {}
+		
+		asio::steady_timer	mTimer;
+		//! Held while a tick runs.
+		std::mutex			mMutex;
+		//! Cleared by detachPacingTimer().
+		SenderBase*			mSender;
+	};
+	
+	PacingOptions						mPacingOptions;
+	std::atomic<bool>					mPacingEnabled;
+	bool								mPacingTimerArmed;
+	//! Packets cleared to go, waiting for dispatchReadyPackets, and whether a thread is sending them.
+	std::vector<PacedPacket>			mReadyPackets;
+	bool								mDispatchingReady;
+	double								mMessageTokens, mByteTokens;
+	PacingClock::time_point				mLastRefill;
+	std::deque<PacedPacket>				mPacingQueue;
+	std::shared_ptr<PacingTimer>		mPacingTimer;
+	PacingStats							mPacingStats;
+	uint64_t							mTotalPacingDelayUs;
+	mutable std::mutex					mPacingMutex;
+	
+	//! Returns true if \a data, encoded from a message to \a address, is unchanged from the last value sent
+	//! and shouldn't be sent. Otherwise records it as the last value.
+	bool isUnchanged( const std::string &address, const ByteBufferRef &data );
+	//! Forgets \a address's last value if it's still \a data.
+	void forgetLastValue( const std::string &address, const ByteBufferRef &data );
+	
+	struct LastValue {
+		size_t					hash;
+		ByteBuffer				bytes;
+		PacingClock::time_point	sent;
+	};
+	
+	std::atomic<bool>							mChangeSuppressionEnabled;
+	std::chrono::milliseconds					mRefreshInterval;
+	std::unordered_map<std::string, LastValue>	mLastValues;
+	std::atomic<uint64_t>						mSuppressedCount;
+	std::mutex									mLastValuesMutex;
 };
 	
 //! Represents an OSC Sender (called a \a server in the OSC spec) and implements the UDP
@@ -504,24 +740,55 @@ public:
 	//! already constructed sockets for more indepth configuration. Expects the local endpoint to be constructed.
 	SenderUdp( const UdpSocketRef &socket, const protocol::endpoint &destination );
 	//! Default virtual constructor
-	virtual ~SenderUdp() = default;
+	virtual ~SenderUdp();
 	
 	//! Returns the local address of the endpoint associated with this socket.
 	protocol::endpoint getLocalAddress() const { return mSocket->local_endpoint(); }
 	//! Returns the remote address of the endpoint associated with this transport.
 	const protocol::endpoint& getRemoteAddress() const { return mRemoteEndpoint; }
 	
+	//! Sends \a messages to the destination endpoint as one burst. If segmentation offload is enabled and
+	//! supported, runs of equal-sized datagrams are packed into a single buffer and handed to the kernel in
+	//! one synchronous syscall, which segments them back into individual datagrams. Anything that can't be
+	//! offloaded, including runs that would cross the high-water mark or while pacing, falls back to the
+	//! regular asynchronous send. So does a run while earlier asynchronous sends are still outstanding, as
+	//! the synchronous syscall would overtake them. Offloaded runs count as in flight and are checked for
+	//! change suppression like any other send. Safe to call from several threads at once.
+	void sendBurst( const std::vector<Message> &messages ) { sendBurst( messages, nullptr ); }
+	//! Sends \a messages as sendBurst() does, calling \a onComplete once for each of them as it's done.
+	void sendBurst( const std::vector<Message> &messages, SendCompletionFn onComplete );
+	//! Enables or disables UDP generic segmentation offload (Linux UDP_SEGMENT) for sendBurst. Disabled by default.
+	void setSegmentationOffloadEnabled( bool enable ) { mSegmentationOffloadEnabled = enable; }
+	//! Returns whether segmentation offload is enabled.
+	bool isSegmentationOffloadEnabled() const { return mSegmentationOffloadEnabled; }
+	//! Returns whether the kernel supports segmentation offload on this socket. Determined at bind and
+	//! cleared for good once the kernel refuses an offloaded send as unsupported or invalid.
+	bool isSegmentationOffloadSupported() const { return mSegmentationOffloadSupported; }
+	
 protected:
 	//! Opens and Binds the underlying UDP socket to the protocol and localEndpoint respectively.
 	void bindImpl() override;
 	//! Sends the byte buffer /a data to the remote endpoint using the UDP socket, asynchronously.
-	void sendImpl( const ByteBufferRef &data ) override;
+	void sendImpl( const ByteBufferRef &data, SendCompletionFn onComplete ) override;
 	//! Closes the underlying UDP socket.
 	void closeImpl() override;
+	//! Returns the io_service of the underlying UDP socket.
+	asio::io_service& getIoService() override { return mSocket->get_io_service(); }
+	//! Sends the equal-sized \a datagrams in [\a begin, \a end) as one segmented buffer, packed into the
+	//! burst's \a segmentBuffer, calling each one's entry in \a completions once it's gone. Returns false if the
+	//! socket is closed, asynchronous sends are outstanding, the run would cross the high-water mark or the
+	//! kernel couldn't take the buffer, in which case nothing was sent.
+	bool sendSegmented( const std::vector<ByteBufferRef> &datagrams, const std::vector<SendCompletionFn> &completions,
+						size_t begin, size_t end, size_t segmentSize, ByteBuffer &segmentBuffer );
 	
 	UdpSocketRef			mSocket;
 	protocol::endpoint		mLocalEndpoint, mRemoteEndpoint;
 	
+	bool					mSegmentationOffloadEnabled;
+	std::atomic<bool>		mSegmentationOffloadSupported;
+	//! Asynchronous sends whose handlers haven't run yet, which a segmented send mustn't overtake.
+	std::atomic<size_t>		mPendingSends;
+	
 public:
 	//! Non-copyable.
 	SenderUdp( const SenderUdp &other ) = delete;
@@ -538,6 +805,44 @@ public:
 class SenderTcp : public SenderBase {
 public:
 	using protocol = asio::ip::tcp;
+	//! Describes the trade off between the latency of each message and the overall throughput.
+	enum class LatencyPolicy {
+		//! Writes every send immediately and leaves the socket's TCP_NODELAY setting untouched.
+		DEFAULT,
+		//! Disables Nagle's algorithm (TCP_NODELAY) and writes every send immediately.
+		LOW_LATENCY,
+		//! Leaves Nagle's algorithm on and corks sends in the write queue until flush() is called or the
+		//! flush interval elapses, so they go out in as few, as large writes as possible. The corking is a
+		//! userspace coalescing queue, not TCP_CORK, so it works the same on every platform.
+		THROUGHPUT
+	};
+	//! Describes what happens to the sends buffered while disconnected, once the connection is back.
+	enum class ReconnectPolicy {
+		//! Writes them in order, ahead of anything sent afterwards.
+		REPLAY,
+		//! Completes them with asio::error::not_connected.
+		DROP
+	};
+	//! Options for auto reconnect. See setAutoReconnect().
+	struct ReconnectOptions {
+		ReconnectOptions()
+		: initialDelay( 100 ), maxDelay( 10000 ), backoffMultiplier( 2.0 ), maxBufferedMessages( 1024 ),
+			maxBufferedBytes( 1 << 20 ), policy( ReconnectPolicy::REPLAY ) {}
+		
+		//! Delay before the first attempt after losing the connection.
+		std::chrono::milliseconds	initialDelay;
+		//! Upper bound of the delay between attempts.
+		std::chrono::milliseconds	maxDelay;
+		//! Factor the delay grows by after each failed attempt.
+		double						backoffMultiplier;
+		//! Maximum number of sends buffered while disconnected. Once full, the oldest is completed with
+		//! asio::error::no_buffer_space to make room.
+		size_t						maxBufferedMessages;
+		//! Maximum number of transported bytes buffered while disconnected, handled like maxBufferedMessages.
+		size_t						maxBufferedBytes;
+		ReconnectPolicy				policy;
+	};
+	
 	//! Constructs a Sender (called a \a server in the OSC spec) using TCP as transport, whose local endpoint is
 	//! defined by \a localPort and \a protocol, which defaults to v4, and remote endpoint is defined by \a
 	//! destinationHost and \a destinationPort. Takes an optional io_service to construct the socket from.
@@ -561,7 +866,7 @@ public:
 	//! constructed.
 	SenderTcp( const TcpSocketRef &socket, const protocol::endpoint &destination,
 			   PacketFramingRef packetFraming = nullptr );
-	virtual ~SenderTcp() = default;
+	virtual ~SenderTcp();
 	
 	//! Connects to the remote endpoint using the underlying socket. Has to be called before attempting to send anything.
 	void connect();
@@ -571,17 +876,104 @@ public:
 	//! Returns the remote address of the endpoint associated with this transport.
 	const protocol::endpoint& getRemoteEndpoint() const { return mRemoteEndpoint; }
 	
+	//! Sets the latency \a policy, DEFAULT by default. Under THROUGHPUT, corked sends are flushed every
+	//! \a flushInterval, or only by calling flush() if it's 0.
+	void setLatencyPolicy( LatencyPolicy policy, std::chrono::milliseconds flushInterval = std::chrono::milliseconds( 0 ) );
+	//! Returns the current latency policy.
+	LatencyPolicy getLatencyPolicy() const { return mLatencyPolicy.load(); }
+	//! Writes everything corked under LatencyPolicy::THROUGHPUT.
+	void flush();
+	//! Sets the socket's send buffer size (SO_SNDBUF) to \a bytes. 0 leaves the system default.
+	void setSendBufferSize( int bytes );
+	//! Returns the send buffer size requested with setSendBufferSize, 0 for the system default.
+	int getSendBufferSize() const { return mSendBufferSize; }
+	
+	//! Enables reconnecting with exponential backoff whenever connecting fails or the connection is lost,
+	//! until close() is called. Sends made while disconnected are buffered and handled by \a options.policy
+	//! once connected. Buffered sends count as in flight for the high-water mark.
+	void setAutoReconnect( const ReconnectOptions &options = ReconnectOptions() );
+	//! Disables auto reconnect. Buffered sends are completed with asio::error::not_connected.
+	void disableAutoReconnect();
+	//! Returns whether auto reconnect is enabled.
+	bool isAutoReconnectEnabled() const { return mAutoReconnectEnabled; }
+	//! Returns whether the socket is currently connected to the remote endpoint.
+	bool isConnected() const { return mConnected; }
+	//! Returns the number of sends currently buffered while disconnected.
+	size_t getBufferedCount() const;
+	
 protected:
 	//! Opens and Binds the underlying TCP socket to the protocol and localEndpoint respectively.
 	void bindImpl() override;
-	//! Sends the byte buffer /a data to the remote endpoint using the TCP socket, asynchronously.
-	void sendImpl( const ByteBufferRef &data ) override;
+	//! Queues the byte buffer /a data to be written to the remote endpoint using the TCP socket, asynchronously.
+	//! Only one write is outstanding at a time, everything queued meanwhile goes out in the next gather write.
+	void sendImpl( const ByteBufferRef &data, SendCompletionFn onComplete ) override;
 	//! Closes the underlying TCP socket.
 	void closeImpl() override;
+	//! Returns the io_service of the underlying TCP socket.
+	asio::io_service& getIoService() override { return mSocket->get_io_service(); }
+	
+	//! A framed send waiting to be written, along with its completion.
+	struct QueuedWrite {
+		ByteBufferRef		data;
+		SendCompletionFn	onComplete;
+	};
+	
+	//! Starts a single scatter-gather write of everything queued. Expects mWriteMutex to be held.
+	void writeQueued();
+	//! Applies the latency policy and send buffer size to the socket, if it's open.
+	void applySocketOptions();
+	//! Handles the completion of an async_connect, replaying or dropping the buffered sends.
+	void handleConnect( const asio::error_code &error );
+	//! Marks the connection as lost and, with auto reconnect, closes the socket, buffers the corked writes
+	//! and schedules a reconnect. Writes that don't fit are moved to \a dropped. Expects mWriteMutex to be held.
+	void handleDisconnect( std::vector<QueuedWrite> &dropped );
+	//! Arms the reconnect timer with the current backoff delay. Expects mWriteMutex to be held.
+	void scheduleReconnect();
+	//! Watches the connection with a one byte read, so a peer closing it is noticed without sending.
+	void watchConnection( uint64_t connectionId );
+	//! Buffers \a write while disconnected, moving writes that no longer fit to \a dropped. Expects
+	//! mWriteMutex to be held.
+	void bufferWrite( QueuedWrite &&write, std::vector<QueuedWrite> &dropped );
+	//! Moves every buffered write, oldest first, to the back of \a writes. Expects mWriteMutex to be held.
+	void takeBufferedWrites( std::vector<QueuedWrite> &writes );
+	//! Completes \a writes with \a error. Must be called without mWriteMutex held.
+	void completeWrites( std::vector<QueuedWrite> &writes, const asio::error_code &error );
+	//! Completes \a writes with \a error from the io_service rather than the calling thread, which may be
+	//! holding a lock a completion that sends again would take. Clears \a writes.
+	void postCompleteWrites( std::vector<QueuedWrite> &writes, const asio::error_code &error );
+	//! Returns a buffer to frame a send into, reusing one from mFramePool if possible.
+	ByteBufferRef acquireFrameBuffer();
+	//! Returns the framed buffers of \a writes to mFramePool and clears \a writes. Must be called without
+	//! mWriteMutex held.
+	void recycleFrameBuffers( std::vector<QueuedWrite> &writes );
 	
 	TcpSocketRef			mSocket;
 	asio::ip::tcp::endpoint mLocalEndpoint, mRemoteEndpoint;
 	
+	std::vector<QueuedWrite>		mQueuedWrites, mActiveWrites;
+	std::vector<asio::const_buffer>	mWriteBuffers;
+	//! Spent framing buffers, whose capacity is reused by the next sends.
+	std::vector<ByteBufferRef>		mFramePool;
+	bool							mWriteInProgress;
+	mutable std::mutex				mWriteMutex;
+	
+	std::atomic<LatencyPolicy>			mLatencyPolicy;
+	std::chrono::milliseconds			mFlushInterval;
+	bool								mFlushRequested, mFlushTimerArmed;
+	int									mSendBufferSize;
+	std::unique_ptr<asio::steady_timer>	mFlushTimer;
+	
+	ReconnectOptions					mReconnectOptions;
+	bool								mAutoReconnectEnabled, mConnectRequested, mWatchingConnection;
+	std::atomic<bool>					mConnected;
+	uint64_t							mConnectionId;
+	std::chrono::milliseconds			mReconnectDelay;
+	std::unique_ptr<asio::steady_timer>	mReconnectTimer;
+	//! Ring of sends buffered while disconnected, allocated once by setAutoReconnect.
+	std::vector<QueuedWrite>			mBufferedWrites;
+	size_t								mBufferedHead, mBufferedCount, mBufferedBytes;
+	uint8_t								mWatchByte;
+	
 public:
 	//! Non-copyable.
 	SenderTcp( const SenderTcp &other ) = delete;
@@ -593,6 +985,145 @@ public:
 	SenderTcp& operator=( SenderTcp &&other ) = delete;
 };
 
+//! Represents an OSC address pattern compiled once into a matcher. Follows the OSC 1.0 rules,
+//! '?' matches any single character, '*' any run of characters, "[...]" any character in the
+//! list or range, negated by a leading '!', and "{...,...}" any of the comma separated strings.
+//! None of them match a '/'. An unterminated '[' or '{' is matched literally.
+class PatternMatcher {
+public:
+	PatternMatcher() = default;
+	explicit PatternMatcher( const std::string &pattern );
+	
+	//! Returns true if the address, \a data of \a size, matches this pattern.
+	bool match( const char *data, size_t size ) const;
+	//! Returns true if \a address matches this pattern.
+	bool match( const std::string &address ) const { return match( address.data(), address.size() ); }
+	
+	//! Returns the pattern this matcher was compiled from.
+	const std::string& getPattern() const { return mPattern; }
+	//! Returns true if the pattern holds no pattern matching characters and only matches itself.
+	bool isLiteral() const { return mKind == Kind::LITERAL; }
+	
+protected:
+	//! The fast paths a pattern can be matched with, GLOB interprets the tokens.
+	enum class Kind { LITERAL, PREFIX, GLOB };
+	struct Token {
+		enum class Type { LITERAL, ANY, ANY_RUN, SET, ALTERNATIVES };
+		explicit Token( Type type ) : mType( type ) {}
+		
+		Type						mType;
+		std::string					mLiteral;
+		std::bitset<256>			mSet;
+		std::vector<std::string>	mAlternatives;
+	};
+	
+	//! Matches \a data of \a size against the tokens from \a token onwards.
+	bool matchTokens( size_t token, const char *data, size_t size ) const;
+	
+	std::string			mPattern;
+	Kind				mKind = Kind::LITERAL;
+	std::vector<Token>	mTokens;
+};
+
+//! A bounded, lock-free ring handing values from one producer thread to one consumer thread.
+//! Values are moved into slots allocated up front, so pushing and popping never allocate. The
+//! producer and consumer indices sit on separate cache lines so the two threads don't contend.
+template<typename T>
+class SpscRing {
+public:
+	//! Constructs a ring holding at least \a capacity values, rounded up to a power of two.
+	explicit SpscRing( size_t capacity )
+	: mHead( 0 ), mCachedTail( 0 ), mTail( 0 ), mCachedHead( 0 )
+	{
+		size_t size = 1;
+		while( size < capacity )
+			size <<= 1;
+		mSlots.resize( size );
+		mMask = size - 1;
+	}
+	
+	//! Moves \a value into the ring. Returns false, leaving \a value untouched, if the ring is
+	//! full. Only call from the producer thread.
+	bool tryPush( T &&value )
+	{
+		auto tail = mTail.load( std::memory_order_relaxed );
+		if( tail - mCachedHead > mMask ) {
+			mCachedHead = mHead.load( std::memory_order_acquire );
+			if( tail - mCachedHead > mMask )
+				return false;
+		}
+		mSlots[tail & mMask] = std::move( value );
+		mTail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+	//! Moves the oldest value into \a value. Returns false if the ring is empty. Only call from
+	//! the consumer thread.
+	bool tryPop( T &value )
+	{
+		auto head = mHead.load( std::memory_order_relaxed );
+		if( head == mCachedTail ) {
+			mCachedTail = mTail.load( std::memory_order_acquire );
+			if( head == mCachedTail )
+				return false;
+		}
+		value = std::move( mSlots[head & mMask] );
+		mHead.store( head + 1, std::memory_order_release );
+		return true;
+	}
+	
+	//! Returns the number of values in the ring, which may already be stale when read.
+	size_t size() const { return mTail.load( std::memory_order_acquire ) - mHead.load( std::memory_order_acquire ); }
+	//! Returns the number of values the ring holds.
+	size_t capacity() const { return mSlots.size(); }
+	
+private:
+	std::vector<T>			mSlots;
+	size_t					mMask;
+	// consumer side, the next slot to pop and its last view of the tail
+	std::atomic<size_t>		mHead;
+	size_t					mCachedTail;
+	char					mConsumerPadding[64];
+	// producer side, the next slot to push and its last view of the head
+	std::atomic<size_t>		mTail;
+	size_t					mCachedHead;
+	char					mProducerPadding[64];
+};
+
+//! A lock-free histogram of durations in log scaled buckets, in the style of HdrHistogram. Each
+//! power of two is split into 16 buckets, so recorded values keep about 6% precision from 1ns up.
+//! Recording is a couple of relaxed atomic adds, safe from any number of threads at once. Reads
+//! don't stop recording, so a percentile read during one may be off by the values in flight.
+class LatencyHistogram {
+public:
+	LatencyHistogram() { reset(); }
+	
+	//! Adds \a value to the histogram. Negative values are recorded as zero.
+	void record( std::chrono::nanoseconds value );
+	//! Returns the value \a percentile of the recorded values are at or below, as a fraction, e.g.
+	//! 0.5, 0.99 or 0.999. Rounded up to the top of its bucket. Zero if nothing was recorded.
+	std::chrono::nanoseconds getPercentile( double percentile ) const;
+	//! Returns the largest value recorded.
+	std::chrono::nanoseconds getMax() const { return std::chrono::nanoseconds( mMax.load( std::memory_order_relaxed ) ); }
+	//! Returns the average of the recorded values.
+	std::chrono::nanoseconds getMean() const;
+	//! Returns the number of values recorded.
+	uint64_t getCount() const { return mCount.load( std::memory_order_relaxed ); }
+	//! Forgets every recorded value. Values recorded meanwhile may survive.
+	void reset();
+	
+private:
+	//! Values below 2 * kSubBuckets get a bucket each, above that each power of two gets kSubBuckets.
+	static const size_t kSubBuckets = 16;
+	static const size_t kNumBuckets = ( 64 - 4 ) * kSubBuckets + 2 * kSubBuckets;
+	
+	static size_t getBucket( uint64_t value );
+	//! Returns the largest value that falls into \a bucket.
+	static uint64_t getBucketMax( size_t bucket );
+	
+	std::array<std::atomic<uint64_t>, kNumBuckets>	mBuckets;
+	std::atomic<uint64_t>							mCount, mTotal, mMax;
+};
+
 //! Represents an OSC Receiver(called a \a client in the OSC spec) and implements a unified
 //! interface without implementing any of the networking layer.
 class ReceiverBase {
@@ -615,13 +1146,141 @@ public:
 	void		close() { closeImpl(); }
 	
 	//! Sets a callback, \a listener, to be called when receiving a message with \a address. If a listener exists for this address, \a listener will replace it.
+	//! \a address may hold OSC pattern matching characters, these match within a single address segment.
+	//! Safe to call from any thread, including from within a listener. Dispatches already running finish
+	//! with the listeners they started with.
 	void		setListener( const std::string &address, ListenerFn listener );
 	//! Removes the listener associated with \a address.
 	void		removeListener( const std::string &address );
+	//! Sets the number of message addresses, \a size, whose matching listeners are remembered, so a
+	//! repeated address resolves with a single lookup. Defaults to 256, 0 disables the cache.
+	void		setDispatchCacheSize( size_t size );
+	//! Returns the number of message addresses whose matching listeners are remembered.
+	size_t		getDispatchCacheSize() const { return mDispatchCacheSize; }
+	//! What the receiving thread does with a message when the message queue or a dispatch
+	//! thread's queue is full.
+	enum class QueueOverflowPolicy {
+		//! Discards the message and counts it, see getQueueOverflowCount() and
+		//! getDispatchOverflowCount().
+		DROP_NEWEST,
+		//! Waits for the consumer to make room, stalling the receiving thread meanwhile.
+		BLOCK
+		// There's deliberately no policy discarding the oldest message instead, as only the consuming
+		// thread may take from the message queue's ring.
+	};
+	//! Runs listeners on \a numThreads worker threads instead of the thread that received the message.
+	//! Each message goes to the worker picked by a hash of its address, so messages to one address are
+	//! dispatched in the order they arrived while other addresses run on other workers. A listener whose
+	//! address has wildcards may run on several workers at once. Defaults to 0, dispatching on the
+	//! receiving thread. Each worker queues up to \a maxQueued messages, beyond which \a policy applies.
+	//! Waits for the previous workers to dispatch what they have queued and exit, and the new workers
+	//! only start after that, so messages to one address stay in order across the change. Receiving
+	//! threads dispatching meanwhile queue on the new workers, or wait when switching to 0. It must not
+	//! be called from a listener.
+	void		setDispatchThreads( size_t numThreads, size_t maxQueued = 4096, QueueOverflowPolicy policy = QueueOverflowPolicy::BLOCK );
+	//! Returns the number of worker threads listeners run on, 0 if they run on the receiving thread.
+	size_t		getDispatchThreads() const;
+	//! Returns the number of messages dropped because a dispatch thread's queue was full.
+	uint64_t	getDispatchOverflowCount() const { return mDispatchOverflowCount; }
+	
+	//! Hands decoded messages to another thread, like the app's update() loop, instead of calling
+	//! listeners on the receiving thread. Messages wait in a lock-free ring of \a capacity until
+	//! they're taken with drain() or poll(). Receivers dispatching from several threads take turns
+	//! pushing, the consumer never waits on them. Changing the capacity moves the messages already
+	//! queued to the new queue. Those that don't fit, and everything queued when passing 0 to stop
+	//! queueing, are dropped and counted in getQueueOverflowCount(). Waits for a drain() or poll() in
+	//! progress, so it must not be called from a listener drain() runs.
+	void		setMessageQueue( size_t capacity, QueueOverflowPolicy policy = QueueOverflowPolicy::DROP_NEWEST );
+	//! Calls the listeners matching each queued message on the calling thread. Returns the number
+	//! of messages taken from the queue.
+	size_t		drain();
+	//! Calls \a fn with each queued message on the calling thread. Returns the number of messages.
+	size_t		drain( const ListenerFn &fn );
+	//! Moves up to \a maxMessages queued messages onto the end of \a messages. Returns the number moved.
+	size_t		poll( std::vector<Message> &messages, size_t maxMessages );
+	//! Returns the number of messages dropped because the queue was full or replaced.
+	uint64_t	getQueueOverflowCount() const { return mQueueOverflowCount; }
+	
+	//! What a conflated message is replaced by.
+	enum class ConflationKey {
+		//! A newer message to the same address.
+		ADDRESS,
+		//! A newer message to any address matching the conflation's pattern.
+		PATTERN
+	};
+	//! Keeps only the newest message for addresses matching \a addressPattern, which may hold OSC
+	//! pattern matching characters, until it's delivered with deliverConflated() or by the conflation
+	//! interval. Messages replaced before delivery are discarded, so a slow consumer never builds up a
+	//! backlog and the receiving thread only stores them. Conflated messages skip the message queue
+	//! and the dispatch threads. Setting a pattern again changes its \a key.
+	void		setConflation( const std::string &addressPattern, ConflationKey key = ConflationKey::ADDRESS );
+	//! Stops conflating messages matching \a addressPattern. Messages it conflated that haven't been
+	//! delivered yet still are, then their slots are freed.
+	void		removeConflation( const std::string &addressPattern );
+	//! Calls the listeners matching the newest message of each conflation slot updated since the last
+	//! delivery, on the calling thread and in the order the slots were first updated. Returns the
+	//! number of messages delivered.
+	size_t		deliverConflated();
+	//! Calls \a fn with the newest message of each updated conflation slot. Returns the number of messages.
+	size_t		deliverConflated( const ListenerFn &fn );
+	//! Delivers conflated messages every \a interval on a thread of the receiver's own, which the
+	//! listeners then run on. Defaults to 0, leaving delivery to deliverConflated(). Waits for a
+	//! delivery in progress, so it must not be called from a listener.
+	void		setConflationInterval( std::chrono::microseconds interval );
+	//! Returns the number of conflated messages replaced by a newer one before they were delivered.
+	uint64_t	getConflatedCount() const { return mConflatedCount; }
+	
+	//! Records how long messages took from their sender to reaching this receiver in getOneWayLatency(),
+	//! and from reaching the socket to their listeners in getDispatchDelay(). The send time is the
+	//! message's first time tag argument, as added by Message::appendCurrentTime(), or else the time tag of
+	//! its bundle, so the one-way latency is only as good as the clocks' synchronization. The arrival is
+	//! the receive timestamp, or the time of dispatch without one. The dispatch delay needs receive
+	//! timestamps. Disabled by default.
+	void		setLatencyTracking( bool enable ) { mLatencyTracking = enable; }
+	//! Returns whether latencies are recorded.
+	bool		isLatencyTrackingEnabled() const { return mLatencyTracking; }
+	//! Returns the sender to receiver latencies recorded.
+	const LatencyHistogram&	getOneWayLatency() const { return mOneWayLatency; }
+	//! Returns the times from reaching the socket to being handed to listeners recorded. This includes
+	//! waiting on dispatch threads, the message queue or conflation.
+	const LatencyHistogram&	getDispatchDelay() const { return mDispatchDelay; }
+	
+	//! Message rate of one of the busiest addresses.
+	struct AddressRate {
+		std::string		address;
+		//! Messages per second since tracking started or the stats were reset. Approximate, an address
+		//! may be counted a little high but never low.
+		double			messagesPerSecond;
+	};
+	//! Snapshot of the receiver's counters since it was constructed or the stats were reset.
+	struct Stats {
+		//! Datagrams, or frames on TCP, handed to dispatch.
+		uint64_t					packets;
+		uint64_t					bytes;
+		//! Messages decoded, including those inside bundles.
+		uint64_t					messages;
+		uint64_t					bundles;
+		//! Packets that failed to decode, indexed by ParseError.
+		std::array<uint64_t, size_t( ParseError::NUM_ERRORS )>	parseErrors;
+		//! Messages without a matching listener.
+		uint64_t					unmatchedMessages;
+		//! Datagrams the kernel dropped because the socket's receive buffer was full. Only counted by
+		//! UDP receivers on Linux.
+		uint64_t					kernelDrops;
+		//! The busiest addresses, busiest first, when setAddressRateTracking is used.
+		std::vector<AddressRate>	topAddresses;
+	};
+	//! Returns the current counters. Reads a handful of atomics, plus the busiest addresses when tracked.
+	Stats		getStats() const;
+	//! Zeroes the counters and restarts address rate tracking.
+	void		resetStats();
+	//! Tracks the message rate of the \a topN busiest addresses, reported by getStats(). Costs a lock
+	//! per packet on the receiving thread, so it defaults to 0, which disables it.
+	void		setAddressRateTracking( size_t topN );
 	
 protected:
-	ReceiverBase( PacketFramingRef packetFraming ) : mPacketFraming( packetFraming ) {}
-	virtual ~ReceiverBase() = default;
+	ReceiverBase( PacketFramingRef packetFraming );
+	virtual ~ReceiverBase();
 	//! Non-copyable.
 	ReceiverBase( const ReceiverBase &other ) = delete;
 	//! Non-copyable.
@@ -632,15 +1291,214 @@ protected:
 	ReceiverBase& operator=( ReceiverBase &&other ) = delete;
 	
 	//! decodes and routes messages from the networking layers stream.
-	void dispatchMethods( uint8_t *data, uint32_t size );
+	void dispatchMethods( uint8_t *data, uint32_t size ) { dispatchMethods( data, size, std::chrono::nanoseconds::zero() ); }
+	//! decodes and routes messages from the networking layers stream, stamped with the time the
+	//! packet reached the socket, \a receiveTime, or zero if unknown. Virtual so a transport can route
+	//! its packets to another receiver's listeners.
+	virtual void dispatchMethods( uint8_t *data, uint32_t size, std::chrono::nanoseconds receiveTime );
 	
 	//! Decodes a complete OSC Packet into it's individual parts.
-	bool decodeData( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag = 0 ) const;
+	bool decodeData( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag = 0 );
 	//! Decodes an individual message.
-	bool decodeMessage( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag = 0 ) const;
-	//! Matches the addresses of messages based on the OSC spec.
+	bool decodeMessage( uint8_t *data, uint32_t size, std::vector<Message> &messages, uint64_t timetag = 0 );
+	//! Matches the address \a lhs against the pattern \a rhs based on the OSC spec. Compiles \a rhs
+	//! on every call, listeners keep a PatternMatcher compiled when they're set.
 	bool patternMatch( const std::string &lhs, const std::string &rhs ) const;
 	
+	//! A node of the listener address space, one per address segment. Children with a literal
+	//! segment are found by hash, children whose segment holds wildcards are matched in turn.
+	//! Nodes are immutable once published, setting a listener copies the nodes on its path and
+	//! shares the rest with the previous snapshot.
+	struct ListenerNode {
+		std::unordered_map<std::string, std::shared_ptr<const ListenerNode>>		mLiterals;
+		std::vector<std::pair<PatternMatcher, std::shared_ptr<const ListenerNode>>>	mPatterns;
+		ListenerFn	mListener;
+		//! Order the listener was first set in, dispatch calls matches in this order.
+		uint64_t	mSequence = 0;
+	};
+	using ListenerNodeRef = std::shared_ptr<const ListenerNode>;
+	//! A listener found for a message, with the sequence it's dispatched in.
+	using ListenerMatch = std::pair<uint64_t, const ListenerFn*>;
+	using ListenerMatchesRef = std::shared_ptr<const std::vector<ListenerMatch>>;
+	//! Listeners resolved by message address, for one snapshot. Lookups only read atomics, inserts are
+	//! serialized by mMutex. Each address may sit in any of kNumProbes slots from its hash, and an insert
+	//! into a full window evicts with a second chance clock: a hit sets the slot's referenced bit, the
+	//! insert clears set bits until it finds one that's clear.
+	struct DispatchCache {
+		static const size_t kNumProbes = 4;
+		explicit DispatchCache( size_t size ) : mSlots( size ), mHand( 0 ) {}
+		
+		//! Immutable once it's in a slot.
+		struct Entry {
+			size_t				mHash;
+			std::string			mAddress;
+			ListenerMatchesRef	mMatches;
+		};
+		struct Slot {
+			std::atomic<const Entry*>	mEntry{ nullptr };
+			std::atomic<bool>			mReferenced{ false };
+		};
+		std::vector<Slot>					mSlots;
+		//! Owns every entry that's been in a slot, as a lookup may still be reading one that's been replaced.
+		//! Freed with the snapshot.
+		std::vector<std::unique_ptr<Entry>>	mEntries;
+		size_t								mHand;
+		std::mutex							mMutex;
+	};
+	//! An immutable snapshot of the listeners, swapped whole whenever a listener is set or removed. Its
+	//! dispatch cache starts out empty, so nothing resolved from an older snapshot is ever used.
+	struct ListenerTable {
+		ListenerNodeRef					mRoot;
+		//! Null when the dispatch cache is disabled.
+		std::unique_ptr<DispatchCache>	mCache;
+	};
+	using ListenerTableRef = std::shared_ptr<const ListenerTable>;
+	
+	//! A message waiting on a dispatch worker, with the snapshot its listeners were resolved from.
+	struct DispatchTask {
+		Message				mMessage;
+		ListenerTableRef	mTable;
+		ListenerMatchesRef	mMatches;
+	};
+	//! Runs dispatch tasks on a fixed set of worker threads, each with its own queue. Tasks posted
+	//! with the same hash run on the same worker, in the order they were posted.
+	class DispatchExecutor {
+	public:
+		//! Workers queue up to \a maxQueued tasks each, and don't run any until start() is called.
+		DispatchExecutor( ReceiverBase *receiver, size_t numThreads, size_t maxQueued, QueueOverflowPolicy policy );
+		//! Runs the tasks already queued, then joins the workers.
+		~DispatchExecutor();
+		
+		void	start();
+		void	post( size_t hash, DispatchTask &&task );
+		size_t	getNumThreads() const { return mWorkers.size(); }
+	
+	private:
+		struct Worker {
+			std::mutex					mMutex;
+			//! Signals tasks to the worker, and room in mTasks to posters blocked on it.
+			std::condition_variable		mCondition, mSpace;
+			std::deque<DispatchTask>	mTasks;
+			bool						mStarted = false;
+			bool						mStopping = false;
+			std::thread					mThread;
+		};
+		
+		void run( Worker &worker );
+		
+		ReceiverBase							*mReceiver;
+		size_t									mMaxQueued;
+		QueueOverflowPolicy						mPolicy;
+		std::vector<std::unique_ptr<Worker>>	mWorkers;
+	};
+	
+	//! A ring of decoded messages waiting on the consuming thread.
+	struct MessageQueue {
+		MessageQueue( size_t capacity, QueueOverflowPolicy policy )
+		: mRing( capacity ), mPolicy( policy ), mClosed( false ) {}
+		
+		SpscRing<Message>		mRing;
+		//! Serializes receiving threads, as the ring only takes a single producer.
+		std::mutex				mProducerMutex;
+		//! Serializes drain() and poll() with setMessageQueue() moving the messages out, uncontended
+		//! otherwise.
+		std::mutex				mConsumerMutex;
+		QueueOverflowPolicy		mPolicy;
+		//! Set once the queue's been replaced, so producers stop pushing onto it.
+		std::atomic<bool>		mClosed;
+	};
+	
+	//! An address pattern whose messages are conflated.
+	struct ConflationRule {
+		PatternMatcher	mMatcher;
+		ConflationKey	mKey;
+	};
+	using ConflationRulesRef = std::shared_ptr<const std::vector<ConflationRule>>;
+	//! The newest message for a conflation key.
+	struct ConflationSlot {
+		Message		mMessage;
+		//! Whether mMessage hasn't been delivered yet.
+		bool		mPending = false;
+		//! Whether the slot is freed once delivered. ADDRESS slots are, so a wildcard rule doesn't keep
+		//! one around for every address it ever matched, and so are the slots of a removed rule.
+		bool		mRelease = false;
+	};
+	//! Delivers conflated messages at a fixed interval, defined in the implementation.
+	struct ConflationTicker;
+	
+	//! Stores \a message in its conflation slot if it matches one of \a rules. Returns whether it did.
+	bool conflate( const std::vector<ConflationRule> &rules, Message &message );
+	//! Counters behind getStats(), bumped by whichever thread receives.
+	struct StatsCounters {
+		StatsCounters() { reset(); }
+		void reset();
+		
+		std::atomic<uint64_t>	mPackets, mBytes, mMessages, mBundles, mUnmatchedMessages, mKernelDrops;
+		std::array<std::atomic<uint64_t>, size_t( ParseError::NUM_ERRORS )>	mParseErrors;
+	};
+	//! Approximate message counts of the busiest addresses, kept with the Space-Saving algorithm: once
+	//! every slot is taken, a new address replaces the least counted one and inherits its count. The
+	//! slots form a min-heap on their counts, so counting is logarithmic in the number of slots.
+	struct AddressRateTracker {
+		using Indices = std::unordered_map<std::string, size_t>;
+		//! A slot's count and its address, whose mapped value is the slot's position in mHeap.
+		using Slot = std::pair<uint64_t, Indices::value_type*>;
+		
+		//! Counts one message to \a address, keeping at most \a capacity slots.
+		void count( const std::string &address, size_t capacity );
+		void clear();
+		//! Restores the heap order of the slot at \a index, after its count went up or it was appended.
+		void siftDown( size_t index );
+		void siftUp( size_t index );
+		
+		std::mutex								mMutex;
+		Indices									mIndices;
+		std::vector<Slot>						mHeap;
+		size_t									mTopN = 0;
+		std::chrono::steady_clock::time_point	mStart;
+	};
+	//! Lets one log line through per second and counts the ones held back in between, so a flood
+	//! of bad or unmatched messages doesn't turn into a flood of logging.
+	class LogLimiter {
+	public:
+		LogLimiter() : mNextLog( 0 ), mSuppressed( 0 ) {}
+		//! Returns whether to log now, with the number of lines held back since the last one in \a suppressed.
+		bool allow( uint64_t &suppressed );
+	
+	private:
+		std::atomic<int64_t>	mNextLog;
+		std::atomic<uint64_t>	mSuppressed;
+	};
+	
+	//! Counts and logs a message no listener matched.
+	void reportUnmatched( const Message &message );
+	//! Counts and logs a packet that failed to decode.
+	void reportParseError( ParseError error, const std::string &address );
+	//! Counts \a messages against their addresses for the busiest address rates.
+	void trackAddresses( const std::vector<Message> &messages );
+	//! Records the one-way latency of \a message, if it carries a send time.
+	void recordOneWayLatency( const Message &message );
+	//! Calls \a matches with \a message, in order, recording the dispatch delay first.
+	void callListeners( const Message &message, const std::vector<ListenerMatch> &matches );
+	//! Lets go of \a executor, waking setDispatchThreads if it's waiting for the last holder.
+	void releaseDispatchExecutor( std::shared_ptr<DispatchExecutor> &executor ) const;
+	//! Pushes \a message onto \a queue, following its overflow policy.
+	//! mProducerMutex must be held.
+	void queueMessage( MessageQueue &queue, Message &&message );
+	//! Collects the listeners below \a node matching \a address from \a position onwards.
+	void findListeners( const ListenerNode &node, const std::string &address, size_t position, std::vector<ListenerMatch> &matches ) const;
+	//! Returns the listeners in \a table matching \a address in dispatch order, from the table's cache
+	//! if it's been resolved before. The matches point into \a table.
+	ListenerMatchesRef resolveListeners( const ListenerTable &table, const std::string &address );
+	//! Returns a snapshot of \a root with an empty dispatch cache of mDispatchCacheSize entries.
+	ListenerTableRef makeListenerTable( ListenerNodeRef root ) const;
+	//! Returns a copy of \a node with \a listener set at \a address from \a position onwards.
+	//! \a node may be null, in which case the path is created.
+	static ListenerNodeRef setListenerNode( const ListenerNode *node, const std::string &address, size_t position, const ListenerFn &listener, uint64_t sequence );
+	//! Returns a copy of \a node without the listener at \a address from \a position onwards,
+	//! \a node itself if there's no such listener, or null if the copy is left empty.
+	static ListenerNodeRef removeListenerNode( const ListenerNodeRef &node, const std::string &address, size_t position );
+	
 	//! Abstract bind implementation function.
 	virtual void bindImpl() = 0;
 	//! Abstract listen implementation function.
@@ -648,7 +1506,50 @@ protected:
 	//! Abstract close implementation function.
 	virtual void closeImpl() = 0;
 	
-	Listeners			mListeners;
+	//! The current snapshot, read with std::atomic_load. Writers hold mListenerMutex, copy the snapshot
+	//! and publish the copy with std::atomic_store. Note that the standard library may implement both
+	//! with a short internal spinlock, though never one held across a dispatch or a listener change.
+	ListenerTableRef	mListenerTable;
+	uint64_t			mListenerSequence = 0;
+	//! Written under mListenerMutex.
+	size_t				mDispatchCacheSize = 256;
+	
+	//! Null unless setDispatchThreads is used, read with std::atomic_load like mListenerTable.
+	std::shared_ptr<DispatchExecutor>	mDispatchExecutor;
+	std::mutex							mDispatchExecutorMutex;
+	//! Set while setDispatchThreads waits on the previous workers, so dispatching on the receiving
+	//! thread doesn't overtake what they have queued.
+	std::atomic<bool>					mDispatchSwitching;
+	//! Signals setDispatchThreads that a dispatch let go of an executor, and dispatches waiting to run
+	//! inline that the switch is over.
+	mutable std::mutex					mDispatchSwitchMutex;
+	mutable std::condition_variable		mDispatchSwitchCondition;
+	std::atomic<uint64_t>				mDispatchOverflowCount;
+	//! Null unless setMessageQueue is used, read with std::atomic_load like mListenerTable.
+	std::shared_ptr<MessageQueue>		mMessageQueue;
+	std::atomic<uint64_t>				mQueueOverflowCount;
+	
+	//! Null unless setConflation is used, read with std::atomic_load and written under mListenerMutex.
+	ConflationRulesRef		mConflationRules;
+	//! Slots by conflation key. Elements of an unordered_map don't move, so the pending slots are
+	//! listed by pointer, in the order they were first updated.
+	using ConflationSlots = std::unordered_map<std::string, ConflationSlot>;
+	ConflationSlots										mConflationSlots;
+	std::vector<ConflationSlots::value_type*>			mConflationPending;
+	std::mutex											mConflationMutex;
+	std::atomic<uint64_t>								mConflatedCount;
+	std::unique_ptr<ConflationTicker>					mConflationTicker;
+	std::mutex											mConflationTickerMutex;
+	
+	StatsCounters					mStatsCounters;
+	mutable AddressRateTracker		mAddressRates;
+	//! Mirrors mAddressRates.mTopN, so dispatch checks it without locking.
+	std::atomic<size_t>				mAddressRateTopN;
+	LogLimiter						mUnmatchedLog, mParseErrorLog;
+	
+	std::atomic<bool>				mLatencyTracking;
+	LatencyHistogram				mOneWayLatency, mDispatchDelay;
+	
 	std::mutex			mListenerMutex, mSocketTransportErrorFnMutex;
 	PacketFramingRef	mPacketFraming;
 };
@@ -673,10 +1574,28 @@ public:
 	//! between sender and receiver.
 	ReceiverUdp( UdpSocketRef socket );
 	
-	virtual ~ReceiverUdp() = default;
+	virtual ~ReceiverUdp();
 	
-	// TODO: Check to see that this is needed, see if we can't auto accept a size of datagram.
+	//! No longer used, kept for compatibility. Receiving one datagram at a time and batched receive
+	//! both read into buffers sized for the largest UDP payload, so no datagram is truncated.
 	void setAmountToReceive( uint32_t amountToReceive ) { mAmountToReceive = amountToReceive; }
+	//! Receives up to \a maxDatagrams datagrams per wakeup with a single recvmmsg call, into buffers
+	//! allocated once, and dispatches them as a batch. Each datagram gets a 64KB slot, of which only the
+	//! pages its payload lands in are committed.
+	//! 0 or 1 receives one datagram at a time, which is the default and the only mode off Linux. Each
+	//! receive on Linux brings the kernel's drop count along, reported as Stats::kernelDrops.
+	void setBatchReceiveSize( size_t maxDatagrams ) { mBatchReceiveSize = maxDatagrams; }
+	//! Returns the most datagrams received per wakeup, 0 if batched receive is disabled.
+	size_t getBatchReceiveSize() const { return mBatchReceiveSize; }
+	//! Returns whether batched receive is available on this platform.
+	static bool isBatchReceiveSupported();
+	//! Stamps each received datagram with the time it reached the socket, which its messages return
+	//! from Message::getReceiveTime(). The kernel takes the time on Linux, with SO_TIMESTAMPNS, elsewhere
+	//! it's the time the receive completed. The kernel's timestamps come along with the datagrams, so
+	//! they cost no extra system calls. Off by default.
+	void setReceiveTimestamps( bool enable ) { mReceiveTimestamps = enable; }
+	//! Returns whether received datagrams are stamped with their arrival time.
+	bool isReceiveTimestampsEnabled() const { return mReceiveTimestamps; }
 	//! Returns the local udp::endpoint of the underlying socket.
 	asio::ip::udp::endpoint getLocalEndpoint() { return mSocket->local_endpoint(); }
 	
@@ -693,13 +1612,39 @@ protected:
 	
 	void handleError( const asio::error_code &error, const protocol::endpoint &originator );
 	
+	//! Waits for the socket to become readable, then receives batches of datagrams while they come back full.
+	void listenBatched();
+	//! Receives and dispatches up to mBatchReceiveSize datagrams, at least one, with one recvmmsg call.
+	//! Returns whether the batch was full.
+	bool receiveBatch();
+	//! Returns the time the datagram just received by asio completed, zero if timestamps are off.
+	std::chrono::nanoseconds getLastReceiveTime();
+	//! Sets SO_TIMESTAMPNS, which has the kernel attach timestamps to received datagrams.
+	void setTimestampOption( bool enable );
+	
+	//! Most full batches received per wakeup before waiting for readability again.
+	static const size_t kMaxBatchesPerWakeup = 16;
+	//! Adds datagrams the kernel dropped to the stats. Virtual so a group member counts them for the group.
+	virtual void countKernelDrops( uint64_t drops ) { mStatsCounters.mKernelDrops += drops; }
+	
+	//! The slab of datagram buffers and message headers batched receive fills, defined per platform.
+	struct BatchReceiver;
+	
 	UdpSocketRef						mSocket;
 	asio::ip::udp::endpoint				mLocalEndpoint;
-	asio::streambuf						mBuffer;
+	//! Sender of the datagram being received, only one receive is outstanding at a time.
+	asio::ip::udp::endpoint				mRemoteEndpoint;
+	//! Single datagram receive reads into this off Linux, allocated once at the largest UDP payload.
+	ByteBuffer							mReceiveBuffer;
 	
 	SocketTransportErrorFn<protocol>	mSocketTransportErrorFn;
 	
 	uint32_t							mAmountToReceive;
+	size_t								mBatchReceiveSize;
+	std::unique_ptr<BatchReceiver>		mBatchReceiver;
+	bool								mReceiveTimestamps;
+	//! Whether SO_TIMESTAMPNS is set on the socket.
+	bool								mTimestampOption;
 	
 public:
 	//! Non-copyable.
@@ -712,8 +1657,99 @@ public:
 	ReceiverUdp& operator=( ReceiverUdp &&other ) = delete;
 };
 
+//! Represents an OSC Receiver(called a \a client in the OSC spec) that spreads UDP receive across cores.
+//! Opens several sockets on the same port with SO_REUSEPORT, each received on its own io_service
+//! thread, so the kernel balances incoming datagrams between them. Every socket dispatches to this
+//! receiver's listeners, which may therefore run on any of the threads at once. Closing waits for
+//! each thread to let go of its socket, so don't close from a listener. Linux only, elsewhere a
+//! single socket is opened.
+class ReceiverUdpGroup : public ReceiverBase {
+public:
+	using protocol = asio::ip::udp;
+	//! Constructs a Receiver listening on \a port with \a numSockets sockets of \a protocol, which
+	//! defaults to v4. Each socket gets its own io_service and thread.
+	ReceiverUdpGroup( uint16_t port, size_t numSockets, const protocol &protocol = protocol::v4() );
+	//! Constructs a Receiver listening on \a localEndpoint with \a numSockets sockets.
+	ReceiverUdpGroup( const protocol::endpoint &localEndpoint, size_t numSockets );
+	//! Closes the sockets and joins their threads.
+	virtual ~ReceiverUdpGroup();
+	
+	//! Sets whether all datagrams from one source land on the same socket, and so are dispatched in the
+	//! order they arrived. True by default, which leaves the choice to the kernel's hash of the source
+	//! and destination addresses. False spreads datagrams across the sockets at random, which balances
+	//! a few busy sources better but loses their order. Takes effect on the next bind.
+	void setPreserveSourceOrder( bool preserve ) { mPreserveSourceOrder = preserve; }
+	//! Returns whether datagrams from one source are dispatched in order.
+	bool isPreserveSourceOrder() const { return mPreserveSourceOrder; }
+	//! Sets the batched receive size of every socket, see ReceiverUdp::setBatchReceiveSize.
+	void setBatchReceiveSize( size_t maxDatagrams );
+	//! Sets whether every socket stamps datagrams with their arrival, see ReceiverUdp::setReceiveTimestamps.
+	void setReceiveTimestamps( bool enable );
+	//! Sets the SocketTransportErrorFn of every socket. Called from the thread of the socket that failed.
+	void setSocketErrorFn( SocketTransportErrorFn<protocol> errorFn );
+	
+	//! Returns the number of sockets opened on bind.
+	size_t getNumSockets() const { return mNumSockets; }
+	//! Returns the local endpoint the sockets are bound to, with the port picked if it was 0.
+	const protocol::endpoint& getLocalEndpoint() const { return mLocalEndpoint; }
+	//! Returns whether more than one socket can share the port on this platform.
+	static bool isSupported();
+	
+protected:
+	//! One socket of the group, a ReceiverUdp whose packets go to the group's listeners.
+	class Member : public ReceiverUdp {
+	public:
+		Member( ReceiverUdpGroup *group, UdpSocketRef socket ) : ReceiverUdp( socket ), mGroup( group ) {}
+	
+	protected:
+		void dispatchMethods( uint8_t *data, uint32_t size, std::chrono::nanoseconds receiveTime ) override { mGroup->dispatchMethods( data, size, receiveTime ); }
+		void countKernelDrops( uint64_t drops ) override { mGroup->mStatsCounters.mKernelDrops += drops; }
+		
+		ReceiverUdpGroup	*mGroup;
+	};
+	//! A thread running one member's io_service.
+	struct MemberThread {
+		asio::io_service							mService;
+		std::unique_ptr<asio::io_service::work>		mWork;
+		std::unique_ptr<Member>						mReceiver;
+		std::thread									mThread;
+	};
+	
+	//! Opens and binds a socket per thread, sharing the port.
+	void bindImpl() override;
+	//! Starts every socket receiving.
+	void listenImpl() override;
+	//! Closes every socket, on its own thread.
+	void closeImpl() override;
+	
+	//! Spreads datagrams across the group at random rather than by flow hash.
+	void attachRandomBalancer( const UdpSocketRef &socket );
+	void handleError( const asio::error_code &error, const protocol::endpoint &originator );
+	
+	protocol::endpoint							mLocalEndpoint;
+	size_t										mNumSockets;
+	bool										mPreserveSourceOrder;
+	size_t										mBatchReceiveSize;
+	bool										mReceiveTimestamps;
+	std::vector<std::unique_ptr<MemberThread>>	mThreads;
+	SocketTransportErrorFn<protocol>			mSocketTransportErrorFn;
+	
+public:
+	//! Non-copyable.
+	ReceiverUdpGroup( const ReceiverUdpGroup &other ) = delete;
+	//! Non-copyable.
+	ReceiverUdpGroup& operator=( const ReceiverUdpGroup &other ) = delete;
+	//! Non-Moveable.
+	ReceiverUdpGroup( ReceiverUdpGroup &&other ) = delete;
+	//! Non-Moveable.
+	ReceiverUdpGroup& operator=( ReceiverUdpGroup &&other ) = delete;
+};
+
 //! Represents an OSC Receiver(called a \a client in the OSC spec) and implements the TCP
-//! transport networking layer.
+//! transport networking layer. Each connection reads and dispatches on its own strand, so running the
+//! io_service on several threads receives separate connections in parallel, while packets from one
+//! connection still dispatch in order. Listeners may then run on several threads at once, and as closing
+//! waits for other connections' listeners to return, they mustn't close the receiver.
 class ReceiverTcp : public ReceiverBase {
 public:
 	using protocol = asio::ip::tcp;
@@ -734,7 +1770,7 @@ public:
 	//! constructed tcp::acceptor shared_ptr \a socket. Use this for extra configuration.
 	ReceiverTcp( AcceptorRef acceptor,
 				 PacketFramingRef packetFraming = nullptr );
-	virtual ~ReceiverTcp() = default;
+	virtual ~ReceiverTcp();
 	
 	//! Sets the underlying SocketTransportErrorFn based on the asio::io::tcp protocol.
 	void setSocketTransportErrorFn( SocketTransportErrorFn<protocol> errorFn );
@@ -743,30 +1779,126 @@ public:
 	void setOnAcceptFn( OnAcceptFn acceptFn );
 	//! Closes acceptor. Must rebind to listen again after calling this function.
 	void closeAcceptor();
+	//! Sets the size of the ring buffer each new connection reads into, 64KB by default. Packets larger than it
+	//! are still received, through a separate buffer.
+	void setConnectionBufferSize( size_t size ) { mConnectionBufferSize = size; }
+	//! Returns the size of the ring buffer each new connection reads into.
+	size_t getConnectionBufferSize() const { return mConnectionBufferSize; }
+	//! Sets the largest packet each new connection accepts, 16MB by default. A connection announcing or sending
+	//! a larger one is closed with asio::error::message_size. With a framing that has no StreamDecoder, the
+	//! limit applies to the packet as framed.
+	void setMaxPacketSize( size_t size ) { mMaxPacketSize = size; }
+	//! Returns the largest packet each new connection accepts.
+	size_t getMaxPacketSize() const { return mMaxPacketSize; }
+	//! Sets the most connections open at once, 0 for no limit, which is the default. Connections accepted
+	//! beyond it are closed straight away, without calling the OnAcceptFn. Open connections are left be when
+	//! it's lowered.
+	void setMaxConnections( size_t maxConnections );
+	//! Returns the most connections open at once, 0 if there's no limit.
+	size_t getMaxConnections() const;
+	//! Closes connections nothing has been read from for \a timeout, 0 to keep them open, which is the
+	//! default. Reaps clients that vanished without closing their end. Checked on a wheel of buckets
+	//! turned by one timer, so a connection may stay open up to 1/32 of the timeout longer.
+	void setIdleTimeout( std::chrono::milliseconds timeout );
+	//! Returns how long a connection may go without reading before it's closed, 0 if it never is.
+	std::chrono::milliseconds getIdleTimeout() const;
+	
+	//! Why a connection was closed.
+	enum class CloseReason {
+		//! The client closed its end.
+		PEER_CLOSED,
+		//! The connection was reset.
+		RESET,
+		//! Nothing was read for the idle timeout.
+		IDLE_TIMEOUT,
+		//! Accepted while the maximum number of connections were open.
+		CONNECTION_LIMIT,
+		//! Closed on this side with close().
+		CLOSED,
+		//! A packet was larger than the maximum packet size.
+		PACKET_TOO_LARGE,
+		NUM_REASONS
+	};
+	//! Snapshot of the connection counters since the receiver was constructed or they were reset.
+	struct ConnectionStats {
+		//! Connections accepted, including those closed for the connection limit.
+		uint64_t		accepted;
+		//! Connections accepted per second over the last 10 seconds, or since the stats were reset if
+		//! that's sooner.
+		double			acceptsPerSecond;
+		//! Connections open now.
+		size_t			active;
+		//! Connections closed, indexed by CloseReason.
+		std::array<uint64_t, size_t( CloseReason::NUM_REASONS )>	closed;
+	};
+	//! Returns the connection counters.
+	ConnectionStats getConnectionStats() const;
+	//! Zeroes the connection counters, apart from the number of open connections.
+	void resetConnectionStats();
 	
 protected:
-	//! Handles reading from the socket.
-	struct Connection {
+	//! Handles reading from the socket. Pending reads hold on to the connection, so it outlives its removal
+	//! from mConnections until they've run.
+	struct Connection : public std::enable_shared_from_this<Connection> {
 		Connection( TcpSocketRef socket, ReceiverTcp* transport );
 		
 		~Connection();
 		
-		protocol::endpoint getRemoteEndpoint() { return mSocket->remote_endpoint(); }
+		//! Returns the remote endpoint, or a default one once the socket is closed.
+		protocol::endpoint getRemoteEndpoint() { asio::error_code ec; return mSocket->remote_endpoint( ec ); }
 		protocol::endpoint getLocalEndpoint() { return  mSocket->local_endpoint(); }
 		
 		//! Implements the read on the underlying socket. Handles the async receive completion operations. Any errors from asio are handled internally.
 		void read();
-		//! Simple alias for asio buffer iterator type.
-		using iterator = asio::buffers_iterator<asio::streambuf::const_buffers_type>;
-		//! Static method which is used to read the stream as it's coming in and notate each packet.
-		static std::pair<iterator, bool> readMatchCondition( iterator begin, iterator end );
 		//! Implements the close of this socket
 		void close();
+		//! Stops dispatching and closes the socket, once a handler running on another thread has returned.
+		void shutdown();
+		
+		//! Reads length-prefixed packets into mRing, used without packet framing.
+		void readRing();
+		//! Dispatches every complete packet in mRing, in place unless it straddles the wrap point. Returns false
+		//! when a packet too large for the ring is being read into mScratch instead, or the connection was closed.
+		bool dispatchRing();
+		//! Reads the rest of a packet of \a size bytes, too large for the ring, onto the end of mScratch a ring's
+		//! worth at a time, and dispatches it.
+		void readOversized( size_t size );
+		//! Closes the connection for a packet over mMaxPacketSize.
+		void closePacketTooLarge();
+		//! Copies \a size bytes from mRing, starting at stream \a position, to \a data.
+		void copyFromRing( uint64_t position, size_t size, uint8_t *data ) const;
+		//! Reads whatever is available and feeds it to mDecoder, used when the framing provides a StreamDecoder.
+		void readStream();
+		//! Reads with async_read_until and the framing's messageComplete, used when it doesn't.
+		void readUntil();
+		//! Dispatches the packet of \a size bytes at \a data.
+		void dispatch( uint8_t *data, size_t size );
+		//! Reports a read \a error, returning whether reading should go on.
+		bool handleReadError( const asio::error_code &error );
 		
 		TcpSocketRef			mSocket;
 		ReceiverTcp*			mReceiver;
+		//! Index of this connection's slot in mConnections.
+		uint32_t				mId;
+		//! steady_clock time of the last completed read, in ticks.
+		std::atomic<std::chrono::steady_clock::rep>	mLastRead;
+		//! Runs this connection's read handlers one at a time, other connections' run alongside.
+		asio::io_service::strand	mStrand;
+		//! Held by a running handler, so shutdown() can wait for it to finish with the receiver.
+		std::mutex				mHandlerMutex;
+		//! Set by shutdown(), after which nothing more is dispatched or read.
+		std::atomic<bool>		mShutdown;
+		//! The receiver's maximum packet size when this connection was accepted.
+		size_t					mMaxPacketSize;
+		//! Only used by readUntil.
 		asio::streambuf			mBuffer;
-		std::vector<uint8_t>	mDataBuffer;
+		//! Fixed size ring the stream is read into. The positions count stream bytes and only grow until the
+		//! ring drains, they're taken modulo the ring size to index it.
+		ByteBuffer				mRing;
+		uint64_t				mReadPosition, mWritePosition;
+		//! Holds packets that straddle the ring's wrap point or don't fit in it at all.
+		ByteBuffer				mScratch;
+		std::unique_ptr<PacketFraming::StreamDecoder>	mDecoder;
 		
 		//! Non-copyable.
 		Connection( const Connection &other ) = delete;
@@ -788,21 +1920,44 @@ protected:
 	void accept();
 	//! Implements the close operation for the underlying sockets and acceptor.
 	void closeImpl() override;
-	//! TODO: See if this is safe. Removes a connection from the vector of connections.
-	void cleanConnection( Connection *connection );
+	//! Shuts down every connection and forgets them.
+	void closeConnections();
+	//! Frees \a connection's slot and counts it closed for \a reason. Returns false if it was already gone.
+	bool cleanConnection( Connection *connection, CloseReason reason );
 	
 	void handleError( const asio::error_code &error, const protocol::endpoint &originator );
 	
 	AcceptorRef			mAcceptor;
 	protocol::endpoint	mLocalEndpoint;
+	size_t				mConnectionBufferSize;
+	size_t				mMaxPacketSize;
 	
 	SocketTransportErrorFn<protocol>	mSocketTransportErrorFn;
 	OnAcceptFn							mOnAcceptFn;
 	
-	std::mutex							mDispatchMutex, mConnectionMutex, mOnAcceptFnMutex;
-	
-	using UniqueConnection = std::unique_ptr<Connection>;
-	std::vector<UniqueConnection>			mConnections;
+	std::mutex							mOnAcceptFnMutex;
+	//! Guards the registry and connection counters.
+	mutable std::mutex					mConnectionMutex;
+	
+	using SharedConnection = std::shared_ptr<Connection>;
+	//! Open connections by id. A closed connection's slot goes on mFreeSlots for the next one accepted,
+	//! so neither accepting nor closing searches the registry.
+	std::vector<SharedConnection>			mConnections;
+	std::vector<uint32_t>					mFreeSlots;
+	size_t									mNumConnections, mMaxConnections;
+	
+	uint64_t								mAccepted;
+	std::array<uint64_t, size_t( CloseReason::NUM_REASONS )>	mClosed;
+	std::chrono::steady_clock::time_point	mStatsStart;
+	//! Seconds acceptsPerSecond is averaged over.
+	static const size_t kAcceptWindow = 10;
+	//! Accepts counted per second of the window, each alongside the second since the clock's epoch it
+	//! counts, so a slot left over from an earlier pass of the ring is told apart and started over.
+	std::array<std::pair<int64_t, uint64_t>, kAcceptWindow>	mRecentAccepts;
+	
+	//! Closes idle connections, shared with its timer's handler so a tick can't outlive the receiver.
+	struct IdleWheel;
+	std::shared_ptr<IdleWheel>				mIdleWheel;
 
 	friend struct Connection;
 public:
@@ -826,8 +1981,30 @@ public:
 	ByteBufferRef encode( ByteBufferRef bufferToEncode ) override;
 	//! SLIP decodes \a bufferToDecode returning the decoded ByteBufferRef.
 	ByteBufferRef decode( ByteBufferRef bufferToDecode ) override;
+	//! SLIP encodes \a size bytes of \a data into \a encoded, reusing its capacity.
+	void encodeFrame( const uint8_t *data, size_t size, ByteBuffer &encoded ) override { encode( data, size, encoded ); }
+	//! SLIP decodes \a size bytes of \a data into \a decoded, reusing its capacity.
+	void decodeFrame( const uint8_t *data, size_t size, ByteBuffer &decoded ) override { decode( data, size, decoded ); }
 	//! Message Match condition for SLIP encoding.
 	std::pair<iterator, bool> messageComplete( iterator begin, iterator end ) override;
+	//! Returns a decoder that detects SLIP frames and un-escapes them in the same pass.
+	std::unique_ptr<StreamDecoder> createStreamDecoder() override;
+	
+	//! Returns the worst case encoded size of \a size bytes, with every byte escaped.
+	static size_t getMaxEncodedSize( size_t size ) { return 2 * size + 2; }
+	//! Returns the exact encoded size of \a size bytes of \a data.
+	static size_t getEncodedSize( const uint8_t *data, size_t size );
+	//! SLIP encodes \a size bytes of \a data into \a encodedData, which has to hold at least
+	//! getEncodedSize( data, size ) bytes. Returns the encoded size.
+	static size_t encode( const uint8_t *data, size_t size, uint8_t *encodedData );
+	//! SLIP decodes \a size bytes of \a data into \a decodedData, which has to hold \a size bytes. \a decodedData
+	//! may be \a data itself, to decode in place. Returns the decoded size.
+	static size_t decode( const uint8_t *data, size_t size, uint8_t *decodedData );
+	//! SLIP encodes \a size bytes of \a data into \a encoded, reusing its capacity. Keeping \a encoded around
+	//! between calls makes encoding allocation free.
+	static void encode( const uint8_t *data, size_t size, ByteBuffer &encoded );
+	//! SLIP decodes \a size bytes of \a data into \a decoded, reusing its capacity.
+	static void decode( const uint8_t *data, size_t size, ByteBuffer &decoded );
 	
 	//! Const values used in the SLIP encoding/decoding process.
 	static const uint8_t SLIP_END = 0xC0;
@@ -836,10 +2013,24 @@ public:
 	static const uint8_t SLIP_ESC_ESC = 0xDD;
 	
 protected:
-	//! Implements the encoding process.
-	size_t encode( const uint8_t* data, size_t size, uint8_t* encodedData );
-	//! Implements the decoding process.
-	size_t decode( const uint8_t* data, size_t size, uint8_t* decodedData );
+	//! Returns the first SLIP_END or SLIP_ESC in [ \a begin, \a end ), or \a end. Scans 16 bytes at a time
+	//! where SSE2 or NEON is available.
+	static const uint8_t* findSpecial( const uint8_t *begin, const uint8_t *end );
+	
+	//! Un-escapes into a packet buffer that keeps its capacity between packets. Escapes split across calls to
+	//! consume() are carried over in mEscaped.
+	class SLIPStreamDecoder : public StreamDecoder {
+	public:
+		SLIPStreamDecoder() : mEscaped( false ), mComplete( false ) {}
+		
+		size_t consume( const uint8_t *data, size_t size, bool *packetComplete ) override;
+		uint8_t* getPacketData() override { return mPacket.data(); }
+		size_t getPacketSize() const override { return mPacket.size(); }
+	
+	private:
+		ByteBuffer	mPacket;
+		bool		mEscaped, mComplete;
+	};
 };
 
 namespace time {
@@ -0,0 +1,932 @@
+#include "cinder/app/App.h"
+#include "cinder/app/RendererGl.h"
+#include "cinder/gl/gl.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <random>
+#include <thread>
+
+#include "Osc.h"
+
+using namespace ci;
+using namespace ci::app;
+using namespace std;
+
+using Clock = std::chrono::steady_clock;
+
+//! Runs an io_service on its own thread for the lifetime of a benchmark, so the
+//! measurements don't depend on the app's frame rate.
+class ServiceThread {
+  public:
+	ServiceThread()
+	: mWork( new asio::io_service::work( mService ) ), mThread( [&]{ mService.run(); } )
+	{
+	}
+	~ServiceThread() { stop(); }
+	
+	//! Stops the service and joins the thread. Any handlers still pending are dropped.
+	void stop()
+	{
+		if( ! mThread.joinable() )
+			return;
+		mWork.reset();
+		mService.stop();
+		mThread.join();
+	}
+	
+	asio::io_service& get() { return mService; }
+
+  private:
+	asio::io_service							mService;
+	std::unique_ptr<asio::io_service::work>		mWork;
+	std::thread									mThread;
+};
+
+static int64_t nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( Clock::now().time_since_epoch() ).count();
+}
+
+static bool waitFor( const std::atomic<int> &counter, int target, std::chrono::milliseconds timeout = std::chrono::milliseconds( 5000 ) )
+{
+	auto end = Clock::now() + timeout;
+	while( counter.load() < target ) {
+		if( Clock::now() > end )
+			return false;
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+static int64_t percentile( std::vector<int64_t> samples, double p )
+{
+	if( samples.empty() )
+		return 0;
+	auto index = std::min( samples.size() - 1, size_t( p * samples.size() ) );
+	std::nth_element( samples.begin(), samples.begin() + index, samples.end() );
+	return samples[index];
+}
+
+//! Exposes ReceiverBase's dispatch without a transport, to measure listener lookup by itself.
+class DispatchReceiver : public osc::ReceiverBase {
+  public:
+	DispatchReceiver() : ReceiverBase( nullptr ) {}
+	
+	void dispatch( uint8_t *data, uint32_t size ) { dispatchMethods( data, size ); }
+	bool match( const std::string &address, const std::string &pattern ) const { return patternMatch( address, pattern ); }
+
+  protected:
+	void bindImpl() override {}
+	void listenImpl() override {}
+	void closeImpl() override {}
+};
+
+//! Encodes a message with no arguments, the address padded to 4 bytes followed by an empty type tag.
+static osc::ByteBuffer encodeAddress( const std::string &address )
+{
+	osc::ByteBuffer buffer( ( ( address.size() + 4 ) & ~size_t( 3 ) ) + 4, 0 );
+	memcpy( buffer.data(), address.data(), address.size() );
+	buffer[buffer.size() - 4] = ',';
+	return buffer;
+}
+
+class BenchmarkApp : public App {
+  public:
+	void setup() override;
+	void draw() override;
+	
+	void benchmarkTcpLatencyPolicy( osc::SenderTcp::LatencyPolicy policy, std::chrono::milliseconds flushInterval, int sendBufferSize = 0 );
+	void benchmarkTcpClients( int numThreads );
+	void benchmarkTcpChurn( int numHeld, std::chrono::milliseconds idleTimeout );
+	
+	void benchmarkSlipFraming( int escapeEvery );
+	void benchmarkSlipChunkedFrame();
+	
+	void benchmarkListenerDispatch( int numListeners );
+	
+	void benchmarkPatternMatching();
+	
+	void benchmarkShardedDispatch( int numThreads );
+	void benchmarkReceiverStats( size_t trackedAddresses, bool unmatched );
+	
+	void benchmarkMessageQueue( bool lockFree );
+	void benchmarkConflation( bool conflate );
+	
+	void benchmarkUdpReceive( size_t batchSize );
+	void benchmarkUdpGroup( size_t numSockets, bool preserveSourceOrder );
+	
+	void benchmarkLatencyHistogram();
+	void benchmarkReceiveLatency( size_t batchSize, bool receiveTimestamps );
+	
+	uint16_t mPort = 10100;
+};
+
+void BenchmarkApp::setup()
+{
+	using Policy = osc::SenderTcp::LatencyPolicy;
+	
+	cout << "TCP latency policy, loopback" << endl;
+	benchmarkTcpLatencyPolicy( Policy::LOW_LATENCY, std::chrono::milliseconds( 0 ) );
+	benchmarkTcpLatencyPolicy( Policy::THROUGHPUT, std::chrono::milliseconds( 1 ) );
+	benchmarkTcpLatencyPolicy( Policy::THROUGHPUT, std::chrono::milliseconds( 5 ) );
+	benchmarkTcpLatencyPolicy( Policy::THROUGHPUT, std::chrono::milliseconds( 1 ), 1 << 20 );
+	
+	cout << "TCP receive, 40 clients, listeners doing 2us of work" << endl;
+	for( auto numThreads : { 1, 2, 4, 8 } )
+		benchmarkTcpClients( numThreads );
+	
+	cout << "TCP connection churn, connect, send one packet and close" << endl;
+	benchmarkTcpChurn( 0, std::chrono::milliseconds( 0 ) );
+	benchmarkTcpChurn( 400, std::chrono::milliseconds( 0 ) );
+	benchmarkTcpChurn( 400, std::chrono::milliseconds( 100 ) );
+	
+	cout << "SLIP framing, 1MB payload" << endl;
+	benchmarkSlipFraming( 0 );
+	benchmarkSlipFraming( 64 );
+	benchmarkSlipFraming( 4 );
+	
+	cout << "SLIP frame detection, one 1MB frame in 1KB chunks" << endl;
+	benchmarkSlipChunkedFrame();
+	
+	cout << "Listener dispatch, one in 50 listeners a wildcard" << endl;
+	for( auto numListeners : { 100, 1000, 2000, 10000 } )
+		benchmarkListenerDispatch( numListeners );
+	
+	cout << "Pattern matching throughput" << endl;
+	benchmarkPatternMatching();
+	
+	cout << "Sharded dispatch, 64 addresses, listeners doing 2us of work" << endl;
+	for( auto numThreads : { 0, 1, 2, 4, 8 } )
+		benchmarkShardedDispatch( numThreads );
+	
+	cout << "Receiver stats, 64 addresses" << endl;
+	benchmarkReceiverStats( 0, false );
+	benchmarkReceiverStats( 8, false );
+	benchmarkReceiverStats( 0, true );
+	
+	cout << "Hand-off to the frame thread" << endl;
+	benchmarkMessageQueue( false );
+	benchmarkMessageQueue( true );
+	
+	cout << "Slow frame thread, 64 addresses, listeners doing 2us of work" << endl;
+	benchmarkConflation( false );
+	benchmarkConflation( true );
+	
+	cout << "UDP receive, loopback, bursts of 256 datagrams" << endl;
+	benchmarkUdpReceive( 0 );
+	if( osc::ReceiverUdp::isBatchReceiveSupported() ) {
+		benchmarkUdpReceive( 8 );
+		benchmarkUdpReceive( 32 );
+		benchmarkUdpReceive( 128 );
+	}
+	
+	cout << "UDP receive across SO_REUSEPORT sockets, 4 sources" << endl;
+	benchmarkUdpGroup( 1, true );
+	if( osc::ReceiverUdpGroup::isSupported() ) {
+		benchmarkUdpGroup( 2, true );
+		benchmarkUdpGroup( 4, true );
+		benchmarkUdpGroup( 4, false );
+	}
+	
+	cout << "Latency tracking, loopback, bursts of 64 stamped with appendCurrentTime" << endl;
+	benchmarkLatencyHistogram();
+	benchmarkReceiveLatency( 0, false );
+	benchmarkReceiveLatency( 0, true );
+	if( osc::ReceiverUdp::isBatchReceiveSupported() ) {
+		benchmarkReceiveLatency( 32, false );
+		benchmarkReceiveLatency( 32, true );
+	}
+}
+
+void BenchmarkApp::benchmarkTcpLatencyPolicy( osc::SenderTcp::LatencyPolicy policy, std::chrono::milliseconds flushInterval, int sendBufferSize )
+{
+	const int numPings = 2000;
+	const int numMessages = 200000;
+	
+	ServiceThread service;
+	auto port = mPort++;
+	osc::ReceiverTcp receiver( port, nullptr, asio::ip::tcp::v4(), service.get() );
+	osc::SenderTcp sender( 0, "127.0.0.1", port, nullptr, asio::ip::tcp::v4(), service.get() );
+	
+	std::atomic<int> received( 0 );
+	std::vector<int64_t> latencies;
+	latencies.reserve( numPings );
+	receiver.setListener( "/ping",
+	[&]( const osc::Message &message ) {
+		latencies.push_back( nowUs() - message[0].int64() );
+		received++;
+	});
+	receiver.setListener( "/bulk",
+	[&]( const osc::Message &message ) {
+		received++;
+	});
+	receiver.bind();
+	receiver.listen();
+	
+	sender.setLatencyPolicy( policy, flushInterval );
+	sender.setSendBufferSize( sendBufferSize );
+	sender.bind();
+	sender.connect();
+	
+	// Warm up the connection, also makes sure it's accepted before timing anything.
+	if( ! sender.send( osc::Message( "/bulk" ) ) || ! waitFor( received, 1 ) ) {
+		CI_LOG_E( "Couldn't connect to the receiver on port " << port );
+		return;
+	}
+	
+	// Latency, a single message in flight at a time.
+	received = 0;
+	for( int i = 0; i < numPings; i++ ) {
+		osc::Message message( "/ping" );
+		message.append( nowUs() );
+		sender.send( message );
+		if( ! waitFor( received, i + 1 ) )
+			break;
+	}
+	
+	// Throughput, as many small messages as the sender takes.
+	received = 0;
+	osc::Message bulk( "/bulk" );
+	bulk.append( 1.0f );
+	bulk.append( 2.0f );
+	bulk.append( 3.0f );
+	// "/bulk" and ",fff" padded to 8 bytes each, three floats and the 4 byte length prefix.
+	const double bytesPerMessage = 8 + 8 + 12 + 4;
+	auto start = Clock::now();
+	for( int i = 0; i < numMessages; i++ )
+		sender.send( bulk );
+	sender.flush();
+	bool completed = waitFor( received, numMessages, std::chrono::milliseconds( 30000 ) );
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  " << ( policy == osc::SenderTcp::LatencyPolicy::LOW_LATENCY ? "LOW_LATENCY" : "THROUGHPUT " );
+	cout << " flush " << setw( 2 ) << flushInterval.count() << "ms";
+	cout << " sndbuf " << setw( 7 ) << ( sendBufferSize ? to_string( sendBufferSize ) : "default" );
+	cout << " | latency p50 " << setw( 6 ) << percentile( latencies, 0.5 ) << "us";
+	cout << " p99 " << setw( 6 ) << percentile( latencies, 0.99 ) << "us";
+	cout << " | throughput " << setw( 9 ) << int64_t( received / seconds ) << " msg/s ";
+	cout << fixed << setprecision( 1 ) << setw( 7 ) << ( received * bytesPerMessage / seconds / 1e6 ) << " MB/s";
+	cout << ( completed ? "" : " (timed out)" ) << endl;
+	
+	// Stop before the transports go out of scope, so no handler runs against them.
+	service.stop();
+}
+
+void BenchmarkApp::benchmarkTcpClients( int numThreads )
+{
+	const int numClients = 40;
+	const int numPerClient = 5000;
+	
+	// the receiver's io_service runs on numThreads threads, each connection on its own strand
+	asio::io_service service;
+	auto port = mPort++;
+	osc::ReceiverTcp receiver( port, nullptr, asio::ip::tcp::v4(), service );
+	// each client numbers its messages, which have to arrive in order whichever thread reads them
+	std::atomic<int> received( 0 ), outOfOrder( 0 );
+	std::vector<std::atomic<int>> lastSequence( numClients );
+	for( auto & sequence : lastSequence )
+		sequence = -1;
+	receiver.setListener( "/client",
+	[&]( const osc::Message &message ) {
+		auto &last = lastSequence[message[0].int32()];
+		auto sequence = message[1].int32();
+		if( last.exchange( sequence ) > sequence )
+			outOfOrder++;
+		auto end = Clock::now() + std::chrono::microseconds( 2 );
+		while( Clock::now() < end );
+		received++;
+	});
+	receiver.bind();
+	receiver.listen();
+	
+	asio::io_service senderService;
+	std::vector<std::unique_ptr<osc::SenderTcp>> senders;
+	for( int client = 0; client < numClients; client++ ) {
+		senders.emplace_back( new osc::SenderTcp( 0, "127.0.0.1", port, nullptr, asio::ip::tcp::v4(), senderService ) );
+		senders.back()->bind();
+		senders.back()->connect();
+	}
+	std::unique_ptr<asio::io_service::work> work( new asio::io_service::work( service ) );
+	std::vector<std::thread> threads;
+	for( int i = 0; i < numThreads; i++ )
+		threads.emplace_back( [&] { service.run(); } );
+	senderService.run();
+	senderService.reset();
+	
+	// queue every message up front so the clients' sockets are saturated once they start draining
+	for( int i = 0; i < numPerClient; i++ ) {
+		for( int client = 0; client < numClients; client++ ) {
+			osc::Message message( "/client" );
+			message.append( client );
+			message.append( i );
+			senders[client]->send( message );
+		}
+	}
+	auto start = Clock::now();
+	senderService.run();
+	while( received < numClients * numPerClient && Clock::now() - start < std::chrono::seconds( 30 ) )
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	receiver.close();
+	work.reset();
+	for( auto & thread : threads )
+		thread.join();
+	
+	cout << "  threads " << numThreads;
+	cout << " | " << fixed << setprecision( 0 ) << setw( 8 ) << received / seconds << " msg/s";
+	cout << " | out of order " << outOfOrder << endl;
+}
+
+void BenchmarkApp::benchmarkTcpChurn( int numHeld, std::chrono::milliseconds idleTimeout )
+{
+	const int numClients = 2000;
+	
+	asio::io_service service;
+	auto port = mPort++;
+	osc::ReceiverTcp receiver( port, nullptr, asio::ip::tcp::v4(), service );
+	receiver.setIdleTimeout( idleTimeout );
+	std::atomic<int> received( 0 );
+	receiver.setListener( "/churn", [&]( const osc::Message &message ) { received++; } );
+	receiver.bind();
+	receiver.listen();
+	std::unique_ptr<asio::io_service::work> work( new asio::io_service::work( service ) );
+	std::thread thread( [&] { service.run(); } );
+	
+	// length-prefixed, as the receiver reads without packet framing
+	auto packet = encodeAddress( "/churn" );
+	uint32_t size = htonl( uint32_t( packet.size() ) );
+	asio::io_service clientService;
+	asio::ip::tcp::endpoint destination( asio::ip::address_v4::loopback(), port );
+	// connections the churning clients come and go alongside, quiet ones when there's an idle timeout
+	std::vector<std::unique_ptr<asio::ip::tcp::socket>> held;
+	for( int i = 0; i < numHeld; i++ ) {
+		held.emplace_back( new asio::ip::tcp::socket( clientService ) );
+		held.back()->connect( destination );
+	}
+	
+	auto start = Clock::now();
+	for( int i = 0; i < numClients; i++ ) {
+		asio::ip::tcp::socket client( clientService );
+		client.connect( destination );
+		asio::write( client, asio::buffer( &size, 4 ) );
+		asio::write( client, asio::buffer( packet ) );
+		client.close();
+	}
+	while( received < numClients && Clock::now() - start < std::chrono::seconds( 10 ) )
+		std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	if( idleTimeout.count() > 0 )
+		std::this_thread::sleep_for( idleTimeout * 2 );
+	auto stats = receiver.getConnectionStats();
+	
+	receiver.close();
+	work.reset();
+	thread.join();
+	
+	using Reason = osc::ReceiverTcp::CloseReason;
+	cout << "  held " << setw( 3 ) << numHeld << " idle timeout " << setw( 3 ) << idleTimeout.count() << "ms";
+	cout << " | " << fixed << setprecision( 0 ) << setw( 6 ) << numClients / seconds << " connections/s";
+	cout << " | active " << stats.active << " | closed by peer " << stats.closed[size_t( Reason::PEER_CLOSED )];
+	cout << ", idle " << stats.closed[size_t( Reason::IDLE_TIMEOUT )] << endl;
+}
+
+void BenchmarkApp::benchmarkSlipFraming( int escapeEvery )
+{
+	const int iterations = 200;
+	
+	// Random bytes with no special bytes, then a SLIP_END every escapeEvery bytes on average.
+	std::mt19937 rng( 1 );
+	osc::ByteBuffer payload( 1 << 20 );
+	for( auto & byte : payload ) {
+		byte = uint8_t( rng() );
+		if( byte == osc::SLIPPacketFraming::SLIP_END || byte == osc::SLIPPacketFraming::SLIP_ESC )
+			byte = 0;
+		if( escapeEvery && rng() % escapeEvery == 0 )
+			byte = osc::SLIPPacketFraming::SLIP_END;
+	}
+	
+	osc::ByteBuffer encoded, decoded;
+	auto start = Clock::now();
+	for( int i = 0; i < iterations; i++ )
+		osc::SLIPPacketFraming::encode( payload.data(), payload.size(), encoded );
+	double encodeSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	start = Clock::now();
+	for( int i = 0; i < iterations; i++ )
+		osc::SLIPPacketFraming::decode( encoded.data(), encoded.size(), decoded );
+	double decodeSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	double megabytes = double( iterations ) * payload.size() / 1e6;
+	cout << "  escape every " << setw( 2 ) << escapeEvery << " bytes";
+	cout << " | encode " << fixed << setprecision( 0 ) << setw( 6 ) << megabytes / encodeSeconds << " MB/s";
+	cout << " | decode " << setw( 6 ) << megabytes / decodeSeconds << " MB/s";
+	cout << ( decoded == payload ? "" : " (round trip mismatch)" ) << endl;
+}
+
+void BenchmarkApp::benchmarkSlipChunkedFrame()
+{
+	const size_t chunkSize = 1024;
+	
+	std::mt19937 rng( 2 );
+	osc::ByteBuffer payload( 1 << 20 );
+	for( auto & byte : payload )
+		byte = uint8_t( rng() );
+	osc::SLIPPacketFraming framing;
+	osc::ByteBuffer encoded;
+	framing.encode( payload.data(), payload.size(), encoded );
+	
+	// What async_read_until does with messageComplete, rescanning the whole streambuf after every chunk.
+	asio::streambuf streambuf;
+	size_t completions = 0;
+	auto start = Clock::now();
+	for( size_t offset = 0; offset < encoded.size(); offset += chunkSize ) {
+		auto size = std::min( chunkSize, encoded.size() - offset );
+		streambuf.sputn( reinterpret_cast<const char*>( encoded.data() + offset ), size );
+		auto buffers = streambuf.data();
+		auto begin = asio::buffers_begin( buffers );
+		auto end = asio::buffers_end( buffers );
+		if( framing.messageComplete( begin, end ).second )
+			completions++;
+	}
+	double rescanSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	// The connection's StreamDecoder, carrying its state from one chunk to the next.
+	auto decoder = framing.createStreamDecoder();
+	bool matches = false;
+	start = Clock::now();
+	for( size_t offset = 0; offset < encoded.size(); offset += chunkSize ) {
+		auto data = encoded.data() + offset;
+		auto size = std::min( chunkSize, encoded.size() - offset );
+		while( size > 0 ) {
+			bool packetComplete = false;
+			auto consumed = decoder->consume( data, size, &packetComplete );
+			data += consumed;
+			size -= consumed;
+			if( packetComplete )
+				matches = decoder->getPacketSize() == payload.size() && equal( payload.begin(), payload.end(), decoder->getPacketData() );
+		}
+	}
+	double decoderSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << fixed << setprecision( 2 );
+	cout << "  messageComplete rescan " << setw( 8 ) << rescanSeconds * 1000 << "ms (detection only)";
+	cout << " | StreamDecoder " << setw( 6 ) << decoderSeconds * 1000 << "ms (detection and un-escaping)";
+	cout << ( completions == 1 && matches ? "" : " (frame mismatch)" ) << endl;
+}
+
+void BenchmarkApp::benchmarkListenerDispatch( int numListeners )
+{
+	const int numMessages = 200000;
+	
+	// A control surface laid out as /surface/<page>/<control>, 100 controls to a page, with
+	// every 50th listener matching a row of controls on its page instead.
+	DispatchReceiver receiver;
+	std::vector<osc::PatternMatcher> patterns;
+	std::vector<std::string> addresses;
+	int dispatched = 0;
+	for( int i = 0; i < numListeners; i++ ) {
+		auto page = "/surface/page" + to_string( i / 100 );
+		auto control = to_string( i % 100 );
+		auto address = page + "/control" + control;
+		auto pattern = i % 50 == 0 ? page + "/control" + control.substr( 0, control.size() - 1 ) + "?" : address;
+		patterns.emplace_back( pattern );
+		addresses.push_back( address );
+		receiver.setListener( pattern, [&]( const osc::Message &message ) { dispatched++; } );
+	}
+	
+	// The incoming traffic uses a small, stable set of 100 addresses.
+	std::vector<osc::ByteBuffer> packets;
+	std::mt19937 rng( 3 );
+	for( int i = 0; i < 100; i++ )
+		packets.push_back( encodeAddress( addresses[rng() % addresses.size()] ) );
+	
+	auto timeDispatch = [&] {
+		auto start = Clock::now();
+		for( int i = 0; i < numMessages; i++ ) {
+			auto &packet = packets[rng() % packets.size()];
+			receiver.dispatch( packet.data(), uint32_t( packet.size() ) );
+		}
+		return std::chrono::duration<double>( Clock::now() - start ).count();
+	};
+	double cachedSeconds = timeDispatch();
+	receiver.setDispatchCacheSize( 0 );
+	double treeSeconds = timeDispatch();
+	
+	// The linear scan dispatch used to do, matching every pattern against every message. The
+	// patterns are compiled up front and only the matching is timed, so this is a lower bound.
+	const int numScanned = std::max( 100, numMessages / numListeners );
+	int scanned = 0;
+	auto start = Clock::now();
+	for( int i = 0; i < numScanned; i++ ) {
+		auto &address = addresses[rng() % addresses.size()];
+		for( auto & pattern : patterns )
+			scanned += pattern.match( address );
+	}
+	double scanSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  " << setw( 5 ) << numListeners << " listeners";
+	cout << " | cached " << fixed << setprecision( 0 ) << setw( 4 ) << cachedSeconds / numMessages * 1e9 << " ns/msg";
+	cout << " | tree " << setw( 4 ) << treeSeconds / numMessages * 1e9 << " ns/msg";
+	cout << " | linear scan " << setw( 8 ) << scanSeconds / numScanned * 1e9 << " ns/msg";
+	cout << ( dispatched >= 2 * numMessages && scanned >= numScanned ? "" : " (missed listeners)" ) << endl;
+}
+
+void BenchmarkApp::benchmarkPatternMatching()
+{
+	const int iterations = 1000000;
+	
+	DispatchReceiver receiver;
+	const std::pair<const char*, const char*> patterns[] = {
+		{ "/surface/page12/fader7", "/surface/page12/fader7" },
+		{ "/surface/page12/fader*", "/surface/page12/fader7" },
+		{ "/surface/page1[0-9]/fader?", "/surface/page12/fader7" },
+		{ "/surface/*/{fader,knob}7", "/surface/page12/knob7" },
+	};
+	for( auto & pattern : patterns ) {
+		osc::PatternMatcher matcher( pattern.first );
+		std::string address( pattern.second );
+		int matched = 0;
+		auto start = Clock::now();
+		for( int i = 0; i < iterations; i++ )
+			matched += matcher.match( address );
+		double compiledSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+		
+		// patternMatch compiles the pattern for every call, as setting a listener does once.
+		start = Clock::now();
+		for( int i = 0; i < iterations / 10; i++ )
+			matched += receiver.match( address, pattern.first );
+		double compilingSeconds = std::chrono::duration<double>( Clock::now() - start ).count() * 10;
+		
+		cout << "  " << left << setw( 28 ) << pattern.first << right;
+		cout << " | compiled " << fixed << setprecision( 1 ) << setw( 6 ) << compiledSeconds / iterations * 1e9 << " ns/match";
+		cout << " | compiled per call " << setw( 6 ) << compilingSeconds / iterations * 1e9 << " ns/match";
+		cout << ( matched == iterations + iterations / 10 ? "" : " (mismatch)" ) << endl;
+	}
+}
+
+void BenchmarkApp::benchmarkShardedDispatch( int numThreads )
+{
+	const int numAddresses = 64;
+	const int numMessages = 100000;
+	
+	DispatchReceiver receiver;
+	receiver.setDispatchThreads( numThreads );
+	std::atomic<int> dispatched( 0 );
+	// each address checks its messages arrive in order, whichever worker it runs on
+	std::vector<int> lastSequence( numAddresses, -1 );
+	std::atomic<int> outOfOrder( 0 );
+	std::vector<osc::ByteBuffer> packets;
+	for( int i = 0; i < numAddresses; i++ ) {
+		auto address = "/sharded/" + to_string( i );
+		receiver.setListener( address,
+		[&, i]( const osc::Message &message ) {
+			auto end = Clock::now() + std::chrono::microseconds( 2 );
+			while( Clock::now() < end );
+			if( message[0].int32() <= lastSequence[i] )
+				outOfOrder++;
+			lastSequence[i] = message[0].int32();
+			dispatched++;
+		});
+		packets.push_back( encodeAddress( address ) );
+	}
+	
+	// "/sharded/N" with an int argument, the type tag and argument follow the address
+	for( auto & packet : packets ) {
+		packet[packet.size() - 3] = 'i';
+		packet.resize( packet.size() + 4, 0 );
+	}
+	
+	auto start = Clock::now();
+	for( int i = 0; i < numMessages; i++ ) {
+		auto packet = packets[i % numAddresses];
+		auto sequence = htonl( uint32_t( i / numAddresses ) );
+		memcpy( packet.data() + packet.size() - 4, &sequence, 4 );
+		receiver.dispatch( packet.data(), uint32_t( packet.size() ) );
+	}
+	bool completed = waitFor( dispatched, numMessages, std::chrono::milliseconds( 30000 ) );
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  " << ( numThreads ? "workers " + to_string( numThreads ) : "receiving thread" );
+	cout << " | " << fixed << setprecision( 0 ) << setw( 8 ) << dispatched / seconds << " msg/s";
+	cout << ( completed ? "" : " (timed out)" ) << ( outOfOrder ? " (out of order)" : "" ) << endl;
+	receiver.setDispatchThreads( 0 );
+}
+
+void BenchmarkApp::benchmarkReceiverStats( size_t trackedAddresses, bool unmatched )
+{
+	const int numAddresses = 64;
+	const int numMessages = 1000000;
+	
+	DispatchReceiver receiver;
+	std::vector<osc::ByteBuffer> packets;
+	for( int i = 0; i < numAddresses; i++ )
+		packets.push_back( encodeAddress( "/stats/" + to_string( i ) ) );
+	// unmatched messages used to log one line each
+	if( ! unmatched )
+		receiver.setListener( "/stats/*", []( const osc::Message &message ) {} );
+	receiver.setAddressRateTracking( trackedAddresses );
+	
+	auto start = Clock::now();
+	for( int i = 0; i < numMessages; i++ ) {
+		auto &packet = packets[i % numAddresses];
+		receiver.dispatch( packet.data(), uint32_t( packet.size() ) );
+	}
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	auto stats = receiver.getStats();
+	
+	cout << "  " << ( unmatched ? "unmatched, rate limited log" : trackedAddresses ? "top 8 address rates        " : "counters only              " );
+	cout << " | " << fixed << setprecision( 0 ) << setw( 4 ) << seconds / numMessages * 1e9 << " ns/msg";
+	cout << " | messages " << stats.messages << " unmatched " << stats.unmatchedMessages;
+	if( ! stats.topAddresses.empty() )
+		cout << " | busiest " << stats.topAddresses.front().address << " " << stats.topAddresses.front().messagesPerSecond << " msg/s";
+	cout << endl;
+}
+
+void BenchmarkApp::benchmarkMessageQueue( bool lockFree )
+{
+	const int numMessages = 500000;
+	
+	DispatchReceiver receiver;
+	auto packet = encodeAddress( "/frame" );
+	int consumed = 0;
+	
+	// What apps did before, a listener pushing onto a mutex guarded queue the frame thread empties.
+	std::mutex mutex;
+	std::deque<osc::Message> queue;
+	if( lockFree ) {
+		receiver.setMessageQueue( 4096, osc::ReceiverBase::QueueOverflowPolicy::BLOCK );
+	}
+	else {
+		receiver.setListener( "/frame",
+		[&]( const osc::Message &message ) {
+			std::lock_guard<std::mutex> lock( mutex );
+			queue.push_back( message );
+		});
+	}
+	
+	auto start = Clock::now();
+	std::thread producer( [&] {
+		for( int i = 0; i < numMessages; i++ )
+			receiver.dispatch( packet.data(), uint32_t( packet.size() ) );
+	});
+	std::deque<osc::Message> frame;
+	while( consumed < numMessages ) {
+		size_t taken = 0;
+		if( lockFree ) {
+			taken = receiver.drain( [&]( const osc::Message &message ) { consumed++; } );
+		}
+		else {
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				frame.swap( queue );
+			}
+			taken = frame.size();
+			consumed += int( taken );
+			frame.clear();
+		}
+		if( ! taken )
+			std::this_thread::yield();
+	}
+	producer.join();
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  " << ( lockFree ? "setMessageQueue and drain" : "mutex guarded deque      " );
+	cout << " | " << fixed << setprecision( 0 ) << setw( 8 ) << numMessages / seconds << " msg/s" << endl;
+}
+
+void BenchmarkApp::benchmarkConflation( bool conflate )
+{
+	const int numAddresses = 64;
+	const int numFrames = 60;
+	
+	DispatchReceiver receiver;
+	std::vector<osc::ByteBuffer> packets;
+	for( int i = 0; i < numAddresses; i++ )
+		packets.push_back( encodeAddress( "/position/" + to_string( i ) ) );
+	int delivered = 0;
+	receiver.setListener( "/position/*",
+	[&]( const osc::Message &message ) {
+		auto end = Clock::now() + std::chrono::microseconds( 2 );
+		while( Clock::now() < end );
+		delivered++;
+	});
+	if( conflate )
+		receiver.setConflation( "/position/*" );
+	else
+		receiver.setMessageQueue( 1 << 16 );
+	
+	// the producer keeps sending while every frame takes its messages, then stalls for 16ms
+	std::atomic<bool> producing( true );
+	std::atomic<int> produced( 0 );
+	std::thread producer( [&] {
+		for( int i = 0; producing; i++ ) {
+			auto &packet = packets[i % numAddresses];
+			receiver.dispatch( packet.data(), uint32_t( packet.size() ) );
+			produced++;
+		}
+	});
+	double worstFrame = 0;
+	for( int frame = 0; frame < numFrames; frame++ ) {
+		auto start = Clock::now();
+		if( conflate )
+			receiver.deliverConflated();
+		else
+			receiver.drain();
+		worstFrame = std::max( worstFrame, std::chrono::duration<double, std::milli>( Clock::now() - start ).count() );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 16 ) );
+	}
+	producing = false;
+	producer.join();
+	
+	cout << "  " << ( conflate ? "setConflation  " : "setMessageQueue" );
+	cout << " | produced " << setw( 8 ) << produced << " | delivered " << setw( 7 ) << delivered;
+	cout << " | worst frame " << fixed << setprecision( 1 ) << setw( 6 ) << worstFrame << "ms";
+	cout << " | dropped " << setw( 8 ) << receiver.getQueueOverflowCount() << " | replaced " << setw( 8 ) << receiver.getConflatedCount() << endl;
+}
+
+void BenchmarkApp::benchmarkUdpReceive( size_t batchSize )
+{
+	const int numDatagrams = 300000;
+	const int burstSize = 256;
+	
+	// The receiver runs on this thread and only while a burst waits in its socket, so the time
+	// measured is the receive path alone rather than how fast the sender keeps up.
+	asio::io_service service;
+	auto port = mPort++;
+	auto socket = std::make_shared<asio::ip::udp::socket>( service, asio::ip::udp::endpoint( asio::ip::udp::v4(), port ) );
+	socket->set_option( asio::socket_base::receive_buffer_size( 4 << 20 ) );
+	osc::ReceiverUdp receiver( socket );
+	receiver.setBatchReceiveSize( batchSize );
+	int received = 0;
+	receiver.setListener( "/udp", [&]( const osc::Message &message ) { received++; } );
+	receiver.listen();
+	
+	auto packet = encodeAddress( "/udp" );
+	asio::io_service senderService;
+	asio::ip::udp::socket sender( senderService, asio::ip::udp::endpoint( asio::ip::udp::v4(), 0 ) );
+	asio::ip::udp::endpoint destination( asio::ip::address_v4::loopback(), port );
+	
+	Clock::duration receiving( 0 );
+	for( int sent = 0; sent < numDatagrams; sent += burstSize ) {
+		for( int i = 0; i < burstSize; i++ )
+			sender.send_to( asio::buffer( packet ), destination );
+		// loopback sends are delivered by the time send_to returns, anything missing was dropped
+		auto start = Clock::now();
+		while( received < sent + burstSize && Clock::now() - start < std::chrono::milliseconds( 50 ) )
+			service.poll();
+		receiving += Clock::now() - start;
+		received = std::min( received, sent + burstSize );
+	}
+	
+	double seconds = std::chrono::duration<double>( receiving ).count();
+	cout << "  batch " << setw( 3 ) << batchSize;
+	cout << " | " << fixed << setprecision( 0 ) << setw( 8 ) << received / seconds << " datagrams/s";
+	cout << " | received " << setprecision( 1 ) << setw( 5 ) << 100.0 * received / numDatagrams << "%" << endl;
+}
+
+void BenchmarkApp::benchmarkLatencyHistogram()
+{
+	const int numValues = 10000000;
+	
+	osc::LatencyHistogram histogram;
+	auto start = Clock::now();
+	for( int i = 0; i < numValues; i++ )
+		histogram.record( std::chrono::nanoseconds( ( i * 2654435761u ) % 1000000 ) );
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  LatencyHistogram::record " << fixed << setprecision( 1 ) << seconds / numValues * 1e9 << " ns";
+	cout << " | uniform 0-1ms p50 " << histogram.getPercentile( 0.5 ).count() / 1000 << "us";
+	cout << " p99 " << histogram.getPercentile( 0.99 ).count() / 1000 << "us" << endl;
+}
+
+void BenchmarkApp::benchmarkReceiveLatency( size_t batchSize, bool receiveTimestamps )
+{
+	const int numDatagrams = 100000;
+	const int burstSize = 64;
+	
+	// As benchmarkUdpReceive, only the receive path is timed. The dispatch delay includes each burst
+	// waiting in the socket while the rest of it is sent.
+	asio::io_service service;
+	auto port = mPort++;
+	auto socket = std::make_shared<asio::ip::udp::socket>( service, asio::ip::udp::endpoint( asio::ip::udp::v4(), port ) );
+	socket->set_option( asio::socket_base::receive_buffer_size( 4 << 20 ) );
+	osc::ReceiverUdp receiver( socket );
+	receiver.setBatchReceiveSize( batchSize );
+	receiver.setReceiveTimestamps( receiveTimestamps );
+	receiver.setLatencyTracking( true );
+	int received = 0;
+	receiver.setListener( "/latency", [&]( const osc::Message &message ) { received++; } );
+	receiver.listen();
+	
+	asio::io_service senderService;
+	osc::SenderUdp sender( 0, "127.0.0.1", port, asio::ip::udp::v4(), senderService );
+	sender.bind();
+	
+	Clock::duration receiving( 0 );
+	for( int sent = 0; sent < numDatagrams; sent += burstSize ) {
+		for( int i = 0; i < burstSize; i++ ) {
+			osc::Message message( "/latency" );
+			message.appendCurrentTime();
+			sender.send( message );
+		}
+		senderService.poll();
+		auto start = Clock::now();
+		while( received < sent + burstSize && Clock::now() - start < std::chrono::milliseconds( 50 ) )
+			service.poll();
+		receiving += Clock::now() - start;
+		received = std::min( received, sent + burstSize );
+	}
+	double seconds = std::chrono::duration<double>( receiving ).count();
+	
+	auto &oneWay = receiver.getOneWayLatency();
+	auto &dispatch = receiver.getDispatchDelay();
+	cout << "  batch " << setw( 2 ) << batchSize << ( receiveTimestamps ? " timestamps" : "           " );
+	cout << " | " << fixed << setprecision( 0 ) << setw( 7 ) << received / seconds << " datagrams/s";
+	cout << " | one-way p50/p99/p999 " << oneWay.getPercentile( 0.5 ).count() / 1000 << "/" << oneWay.getPercentile( 0.99 ).count() / 1000;
+	cout << "/" << oneWay.getPercentile( 0.999 ).count() / 1000 << "us";
+	if( dispatch.getCount() ) {
+		cout << " | dispatch delay p50/p99/p999 " << dispatch.getPercentile( 0.5 ).count() / 1000 << "/" << dispatch.getPercentile( 0.99 ).count() / 1000;
+		cout << "/" << dispatch.getPercentile( 0.999 ).count() / 1000 << "us";
+	}
+	cout << endl;
+}
+
+void BenchmarkApp::benchmarkUdpGroup( size_t numSockets, bool preserveSourceOrder )
+{
+	const int numSources = 4;
+	const int numPerSource = 50000;
+	
+	auto port = mPort++;
+	osc::ReceiverUdpGroup receiver( port, numSockets );
+	receiver.setPreserveSourceOrder( preserveSourceOrder );
+	receiver.setBatchReceiveSize( 32 );
+	
+	// each source numbers its messages, which have to arrive in order when the source's order is kept
+	std::atomic<int> received( 0 ), outOfOrder( 0 );
+	std::vector<std::atomic<int>> lastSequence( numSources );
+	for( auto & sequence : lastSequence )
+		sequence = -1;
+	receiver.setListener( "/group",
+	[&]( const osc::Message &message ) {
+		auto &last = lastSequence[message[0].int32()];
+		auto sequence = message[1].int32();
+		if( last.exchange( sequence ) > sequence )
+			outOfOrder++;
+		received++;
+	});
+	receiver.bind();
+	receiver.listen();
+	
+	auto start = Clock::now();
+	std::vector<std::thread> sources;
+	for( int source = 0; source < numSources; source++ ) {
+		sources.emplace_back( [=] {
+			asio::io_service service;
+			asio::ip::udp::socket sender( service, asio::ip::udp::endpoint( asio::ip::udp::v4(), 0 ) );
+			asio::ip::udp::endpoint destination( asio::ip::address_v4::loopback(), port );
+			auto packet = encodeAddress( "/group" );
+			packet[packet.size() - 3] = 'i';
+			packet[packet.size() - 2] = 'i';
+			packet.resize( packet.size() + 8, 0 );
+			for( int i = 0; i < numPerSource; i++ ) {
+				uint32_t arguments[] = { htonl( uint32_t( source ) ), htonl( uint32_t( i ) ) };
+				memcpy( packet.data() + packet.size() - 8, arguments, 8 );
+				sender.send_to( asio::buffer( packet ), destination );
+				// leave the receivers room to keep up rather than measuring the kernel dropping datagrams
+				if( i % 64 == 63 )
+					std::this_thread::yield();
+			}
+		});
+	}
+	for( auto & source : sources )
+		source.join();
+	int last = -1;
+	while( received.load() != last ) {
+		last = received.load();
+		std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	}
+	double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+	
+	cout << "  sockets " << receiver.getNumSockets() << ( preserveSourceOrder ? " flow hash" : " random   " );
+	cout << " | " << fixed << setprecision( 0 ) << setw( 8 ) << received / seconds << " msg/s";
+	cout << " | received " << setprecision( 1 ) << setw( 5 ) << 100.0 * received / ( numSources * numPerSource ) << "%";
+	cout << " | out of order " << outOfOrder << endl;
+}
+
+void BenchmarkApp::draw()
+{
+	gl::clear();
+}
+
+#if defined( CINDER_MSW )
+CINDER_APP( BenchmarkApp, RendererGl, []( App::Settings *settings ) { settings->setConsoleWindowEnabled(); } )
+#else
+CINDER_APP( BenchmarkApp, RendererGl );
+#endif
@@ -24,6 +24,9 @@ class TestApp : public App {
 	TestApp();
 	void update() override;
 	
+	//! Checks osc::PatternMatcher against the OSC 1.0 address pattern rules.
+	void checkPatternMatching();
+
 #if TEST_UDP
 	void sendMessageUdp( const osc::Message &message );
 	osc::ReceiverUdp	mReceiver;
@@ -54,6 +57,8 @@ TestApp::TestApp()
 	mReceiver( 10000, mPacketFraming ), mSender( 12345, "127.0.0.1", 10000, mPacketFraming )
 #endif
 {	
+	checkPatternMatching();
+	
 	mReceiver.bind();
 	mReceiver.listen();
 	mReceiver.setListener( "/app/?",
@@ -139,6 +144,48 @@ TestApp::TestApp()
     });
 }
 
+void TestApp::checkPatternMatching()
+{
+	struct Case {
+		const char	*pattern;
+		const char	*address;
+		bool		matches;
+	};
+	const Case cases[] = {
+		// literals
+		{ "/a/b", "/a/b", true }, { "/a/b", "/a/bc", false }, { "/a/b", "/a", false }, { "", "", true },
+		// '?' matches any single character, but not a '/'
+		{ "/a/?", "/a/b", true }, { "/a/?", "/a/", false }, { "/a/?", "/a/bc", false }, { "/a?b", "/a/b", false },
+		// '*' matches any run of characters, including none, within a segment
+		{ "/a/*", "/a/", true }, { "/a/*", "/a/bcd", true }, { "/a/*", "/a/b/c", false }, { "/*", "/a/b", false },
+		{ "/a/*c", "/a/bcbc", true }, { "/a/*c", "/a/bcb", false }, { "/a/b*c*d", "/a/bxcxcxd", true },
+		{ "/a/**", "/a/bc", true }, { "/a/*/c", "/a/b/c", true }, { "/a/*/c", "/a/c", false },
+		// '[]' matches one character from a list or range, '!' negates and '-' at either end is literal
+		{ "/[abc]", "/b", true }, { "/[abc]", "/d", false }, { "/[a-c]", "/b", true }, { "/[a-c]", "/d", false },
+		{ "/[c-a]", "/b", true }, { "/[!a-c]", "/d", true }, { "/[!a-c]", "/b", false }, { "/[a-]", "/-", true },
+		{ "/[-a]", "/-", true }, { "/[a-cx-z]", "/y", true }, { "/[a-cx-z]", "/m", false }, { "/a[!b]", "/a/", false },
+		{ "/[0-9][0-9]", "/42", true }, { "/[0-9][0-9]", "/4", false },
+		// '{}' matches any of the comma separated strings
+		{ "/{foo,bar}", "/bar", true }, { "/{foo,bar}", "/baz", false }, { "/{foo,bar}", "/foobar", false },
+		{ "/{a,ab}c", "/abc", true }, { "/x{,y}", "/x", true }, { "/x{,y}", "/xy", true }, { "/{foo,bar}/*", "/foo/x", true },
+		// unterminated brackets and braces match literally rather than reading past the end
+		{ "/[abc", "/[abc", true }, { "/[abc", "/a", false }, { "/{abc", "/{abc", true }, { "/a[", "/a[", true },
+		{ "/a{", "/a{", true }, { "/*[", "/xx[", true },
+	};
+	
+	size_t numFailed = 0;
+	for( auto & test : cases ) {
+		osc::PatternMatcher matcher( test.pattern );
+		if( matcher.match( test.address ) != test.matches ) {
+			CI_LOG_E( "Pattern " << test.pattern << " against " << test.address << ", expected "
+					  << ( test.matches ? "a match" : "no match" ) );
+			numFailed++;
+		}
+	}
+	auto numCases = sizeof( cases ) / sizeof( cases[0] );
+	CI_LOG_I( "Pattern matching: " << numCases - numFailed << "/" << numCases << " passed" );
+}
+
 void TestApp::update()
 {
 	if( ! mIsConnected ) {